@@ -3,16 +3,18 @@
 #if defined(_WIN32)
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                    LPSTR lpCmdLine, int nCmdShow) {
-  VulkanExample ve = VulkanExample();
+  VulkanExample ve;
   ve.createWindow(hInstance);
   ve.initSwapchain();
   ve.renderLoop();
+  return ve.exitCode();
 }
 #elif defined(__linux__)
 int main(int argc, char *argv[]) {
-  VulkanExample ve = VulkanExample();
+  VulkanExample ve;
   ve.createWindow();
   ve.initSwapchain();
   ve.renderLoop();
+  return ve.exitCode();
 }
 #endif
@@ -0,0 +1,59 @@
+#include "VulkanAllocationCounter.hpp"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocations(0);
+
+static void *allocate(size_t size) {
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+  return malloc(size != 0 ? size : 1);
+}
+
+void VulkanAllocationCounter::enable() { counting.store(true); }
+
+bool VulkanAllocationCounter::enabled() { return counting.load(); }
+
+uint64_t VulkanAllocationCounter::count() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t size) {
+  void *memory = allocate(size);
+
+  if (memory == NULL) throw std::bad_alloc();
+
+  return memory;
+}
+
+void *operator new[](size_t size) {
+  void *memory = allocate(size);
+
+  if (memory == NULL) throw std::bad_alloc();
+
+  return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete[](void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+  free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+  free(memory);
+}
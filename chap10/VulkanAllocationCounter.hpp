@@ -0,0 +1,22 @@
+#ifndef VULKAN_ALLOCATION_COUNTER_HPP
+#define VULKAN_ALLOCATION_COUNTER_HPP
+
+#include <stdint.h>
+
+// Counts heap allocations made by the whole process through operator new,
+// which the project replaces, so a frame loop can check that it no longer
+// allocates once it has warmed up. Counting is off until enable() is
+// called and costs one relaxed atomic increment per allocation after that.
+// The project itself only reaches malloc() through the host allocator, whose
+// heap fallback keeps its own count; checks add the two. Plain malloc()
+// calls inside the driver and libxcb cannot be seen portably and are not
+// counted.
+namespace VulkanAllocationCounter {
+void enable();
+bool enabled();
+
+// Allocations since enable().
+uint64_t count();
+}
+
+#endif  // VULKAN_ALLOCATION_COUNTER_HPP
@@ -0,0 +1,243 @@
+#ifndef VULKAN_BARRIER_BATCH_HPP
+#define VULKAN_BARRIER_BATCH_HPP
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanSync.hpp"
+#include "VulkanTools.hpp"
+
+// Collects memory, buffer and image barriers and records them with a single
+// vkCmdPipelineBarrier per (srcStages, dstStages) pair instead of one call
+// per resource. With synchronization2 every barrier carries its own stages,
+// so the whole batch becomes one vkCmdPipelineBarrier2KHR. Storage is kept
+// between flushes, so a batch that is reused every frame stops allocating
+// after the first few frames.
+class VulkanBarrierBatch {
+ private:
+  struct StageGroup {
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    std::vector<VkMemoryBarrier> memoryBarriers;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+  };
+
+  std::vector<StageGroup> groups;
+  uint32_t groupCount;
+
+#if defined(VK_KHR_synchronization2)
+  std::vector<VkMemoryBarrier2KHR> memoryBarriers2;
+  std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers2;
+  std::vector<VkImageMemoryBarrier2KHR> imageBarriers2;
+
+  void flush2(VkCommandBuffer cmdBuffer, const VulkanSync &sync) {
+    memoryBarriers2.clear();
+    bufferBarriers2.clear();
+    imageBarriers2.clear();
+
+    for (uint32_t i = 0; i < groupCount; i++) {
+      const StageGroup &g = groups[i];
+
+      for (uint32_t j = 0; j < g.memoryBarriers.size(); j++) {
+        const VkMemoryBarrier &src = g.memoryBarriers[j];
+        VkMemoryBarrier2KHR barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+        barrier.srcStageMask = g.srcStages;
+        barrier.srcAccessMask = src.srcAccessMask;
+        barrier.dstStageMask = g.dstStages;
+        barrier.dstAccessMask = src.dstAccessMask;
+        memoryBarriers2.push_back(barrier);
+      }
+
+      for (uint32_t j = 0; j < g.bufferBarriers.size(); j++) {
+        const VkBufferMemoryBarrier &src = g.bufferBarriers[j];
+        VkBufferMemoryBarrier2KHR barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+        barrier.srcStageMask = g.srcStages;
+        barrier.srcAccessMask = src.srcAccessMask;
+        barrier.dstStageMask = g.dstStages;
+        barrier.dstAccessMask = src.dstAccessMask;
+        barrier.srcQueueFamilyIndex = src.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = src.dstQueueFamilyIndex;
+        barrier.buffer = src.buffer;
+        barrier.offset = src.offset;
+        barrier.size = src.size;
+        bufferBarriers2.push_back(barrier);
+      }
+
+      for (uint32_t j = 0; j < g.imageBarriers.size(); j++) {
+        const VkImageMemoryBarrier &src = g.imageBarriers[j];
+        VkImageMemoryBarrier2KHR barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        barrier.srcStageMask = g.srcStages;
+        barrier.srcAccessMask = src.srcAccessMask;
+        barrier.dstStageMask = g.dstStages;
+        barrier.dstAccessMask = src.dstAccessMask;
+        barrier.oldLayout = src.oldLayout;
+        barrier.newLayout = src.newLayout;
+        barrier.srcQueueFamilyIndex = src.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = src.dstQueueFamilyIndex;
+        barrier.image = src.image;
+        barrier.subresourceRange = src.subresourceRange;
+        imageBarriers2.push_back(barrier);
+      }
+    }
+
+    VkDependencyInfoKHR dependencyInfo = {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependencyInfo.memoryBarrierCount = (uint32_t)memoryBarriers2.size();
+    dependencyInfo.pMemoryBarriers = memoryBarriers2.data();
+    dependencyInfo.bufferMemoryBarrierCount = (uint32_t)bufferBarriers2.size();
+    dependencyInfo.pBufferMemoryBarriers = bufferBarriers2.data();
+    dependencyInfo.imageMemoryBarrierCount = (uint32_t)imageBarriers2.size();
+    dependencyInfo.pImageMemoryBarriers = imageBarriers2.data();
+    sync.pipelineBarrier2(cmdBuffer, dependencyInfo);
+  }
+#endif
+
+  StageGroup &group(VkPipelineStageFlags srcStages,
+                    VkPipelineStageFlags dstStages) {
+    for (uint32_t i = 0; i < groupCount; i++)
+      if (groups[i].srcStages == srcStages && groups[i].dstStages == dstStages)
+        return groups[i];
+
+    if (groupCount == groups.size()) groups.resize(groupCount + 1);
+
+    StageGroup &added = groups[groupCount++];
+    added.srcStages = srcStages;
+    added.dstStages = dstStages;
+    return added;
+  }
+
+ public:
+  VulkanBarrierBatch() : groupCount(0) {}
+
+  bool empty() const { return groupCount == 0; }
+
+  void addMemoryBarrier(VkPipelineStageFlags srcStages,
+                        VkPipelineStageFlags dstStages,
+                        VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    group(srcStages, dstStages).memoryBarriers.push_back(barrier);
+  }
+
+  void addBufferBarrier(VkPipelineStageFlags srcStages,
+                        VkPipelineStageFlags dstStages,
+                        const VkBufferMemoryBarrier &barrier) {
+    group(srcStages, dstStages).bufferBarriers.push_back(barrier);
+  }
+
+  void addImageBarrier(VkPipelineStageFlags srcStages,
+                       VkPipelineStageFlags dstStages,
+                       const VkImageMemoryBarrier &barrier) {
+    group(srcStages, dstStages).imageBarriers.push_back(barrier);
+  }
+
+  // The two halves of a queue family ownership transfer of a buffer range.
+  // The release is recorded on a command buffer for the source family and
+  // the acquire on one for the destination family; a semaphore between the
+  // two submissions orders them.
+  void addBufferRelease(VkBuffer buffer, VkDeviceSize offset,
+                        VkDeviceSize size, uint32_t srcFamily,
+                        uint32_t dstFamily, VkPipelineStageFlags srcStages,
+                        VkAccessFlags srcAccess) {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    addBufferBarrier(srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, barrier);
+  }
+
+  void addBufferAcquire(VkBuffer buffer, VkDeviceSize offset,
+                        VkDeviceSize size, uint32_t srcFamily,
+                        uint32_t dstFamily, VkPipelineStageFlags dstStages,
+                        VkAccessFlags dstAccess) {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    addBufferBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, barrier);
+  }
+
+  // Batched equivalents of VulkanTools::setImageLayout().
+  void addImageLayout(VkImage image, VkImageAspectFlags aspects,
+                      VkImageLayout oldLayout, VkImageLayout newLayout) {
+    addImageLayout(image, aspects, oldLayout, newLayout,
+                   VulkanTools::layoutSrcSync(oldLayout).stages,
+                   VulkanTools::layoutDstSync(newLayout).stages);
+  }
+
+  void addImageLayout(VkImage image, VkImageAspectFlags aspects,
+                      VkImageLayout oldLayout, VkImageLayout newLayout,
+                      VkPipelineStageFlags srcStages,
+                      VkPipelineStageFlags dstStages) {
+    addImageBarrier(
+        srcStages, dstStages,
+        VulkanTools::imageLayoutBarrier(image, aspects, oldLayout, newLayout));
+  }
+
+  // Records everything collected so far and empties the batch. Returns the
+  // number of barrier commands that were needed. Passing a VulkanSync that
+  // has synchronization2 enabled selects the single-call path.
+  uint32_t flush(VkCommandBuffer cmdBuffer, const VulkanSync *sync = NULL) {
+    uint32_t calls = 0;
+
+#if defined(VK_KHR_synchronization2)
+    if (sync != NULL && sync->usingSync2() && groupCount > 0) {
+      flush2(cmdBuffer, *sync);
+      calls = 1;
+
+      for (uint32_t i = 0; i < groupCount; i++) {
+        groups[i].memoryBarriers.clear();
+        groups[i].bufferBarriers.clear();
+        groups[i].imageBarriers.clear();
+      }
+
+      groupCount = 0;
+      return calls;
+    }
+#endif
+
+    for (uint32_t i = 0; i < groupCount; i++) {
+      StageGroup &g = groups[i];
+
+      if (g.memoryBarriers.empty() && g.bufferBarriers.empty() &&
+          g.imageBarriers.empty())
+        continue;
+
+      vkd.CmdPipelineBarrier(
+          cmdBuffer, g.srcStages, g.dstStages, 0,
+          (uint32_t)g.memoryBarriers.size(), g.memoryBarriers.data(),
+          (uint32_t)g.bufferBarriers.size(), g.bufferBarriers.data(),
+          (uint32_t)g.imageBarriers.size(), g.imageBarriers.data());
+      calls++;
+
+      g.memoryBarriers.clear();
+      g.bufferBarriers.clear();
+      g.imageBarriers.clear();
+    }
+
+    groupCount = 0;
+    return calls;
+  }
+};
+
+#endif  // VULKAN_BARRIER_BATCH_HPP
@@ -0,0 +1,121 @@
+#ifndef VULKAN_COMMAND_ALLOCATOR_HPP
+#define VULKAN_COMMAND_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+#include <cassert>
+#include <vector>
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanHostAllocator.hpp"
+
+// Hands out command buffers per frame slot. Each slot has its own transient
+// pool that is reset as a whole with one vkResetCommandPool once the slot's
+// fence has signalled, which lets the driver recycle the pool's memory in
+// bulk instead of tracking every buffer. The VkCommandBuffer handles survive
+// the reset and are handed out again, so steady-state frames allocate
+// nothing.
+//
+// With `perBufferReset` the pools are created with
+// VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT and every buffer is reset
+// on its own instead, which is only useful for comparing the two.
+class VulkanCommandAllocator {
+ private:
+  struct Slot {
+    VkCommandPool pool;
+    std::vector<VkCommandBuffer> buffers[2];
+    uint32_t used[2];
+  };
+
+  VkDevice device;
+  std::vector<Slot> slots;
+  bool perBufferReset;
+
+ public:
+  VulkanCommandAllocator() : device(VK_NULL_HANDLE), perBufferReset(false) {}
+
+  void init(VkDevice device, uint32_t queueFamily, uint32_t slotCount,
+            bool perBufferReset = false) {
+    this->device = device;
+    this->perBufferReset = perBufferReset;
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.pNext = NULL;
+    poolInfo.flags = perBufferReset
+                         ? VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+                         : VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    slots.resize(slotCount);
+
+    for (uint32_t i = 0; i < slotCount; i++) {
+      VkResult result = vkd.CreateCommandPool(
+          device, &poolInfo, hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL),
+          &slots[i].pool);
+      assert(result == VK_SUCCESS);
+      slots[i].used[0] = 0;
+      slots[i].used[1] = 0;
+    }
+  }
+
+  void destroy() {
+    // Destroying a pool frees every command buffer allocated from it.
+    for (uint32_t i = 0; i < slots.size(); i++)
+      vkd.DestroyCommandPool(device, slots[i].pool,
+                             hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL));
+
+    slots.clear();
+  }
+
+  uint32_t slotCount() const { return (uint32_t)slots.size(); }
+
+  // Makes every buffer handed out for `slot` available again. The GPU must
+  // be done with them.
+  void reset(uint32_t slot) {
+    Slot &s = slots[slot];
+
+    if (s.used[0] == 0 && s.used[1] == 0) return;
+
+    if (perBufferReset) {
+      for (uint32_t level = 0; level < 2; level++) {
+        for (uint32_t i = 0; i < s.used[level]; i++) {
+          VkResult result = vkd.ResetCommandBuffer(s.buffers[level][i], 0);
+          assert(result == VK_SUCCESS);
+        }
+      }
+    } else {
+      VkResult result = vkd.ResetCommandPool(device, s.pool, 0);
+      assert(result == VK_SUCCESS);
+    }
+
+    s.used[0] = 0;
+    s.used[1] = 0;
+  }
+
+  // Returns a buffer in the initial state, ready for vkBeginCommandBuffer.
+  VkCommandBuffer allocate(
+      uint32_t slot,
+      VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    Slot &s = slots[slot];
+    std::vector<VkCommandBuffer> &buffers = s.buffers[level];
+
+    if (s.used[level] == buffers.size()) {
+      VkCommandBufferAllocateInfo allocInfo = {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.pNext = NULL;
+      allocInfo.commandPool = s.pool;
+      allocInfo.level = level;
+      allocInfo.commandBufferCount = 1;
+
+      VkCommandBuffer cmdBuffer;
+      VkResult result =
+          vkd.AllocateCommandBuffers(device, &allocInfo, &cmdBuffer);
+      assert(result == VK_SUCCESS);
+      buffers.push_back(cmdBuffer);
+    }
+
+    return buffers[s.used[level]++];
+  }
+};
+
+#endif  // VULKAN_COMMAND_ALLOCATOR_HPP
@@ -0,0 +1,149 @@
+#include "VulkanCommandRecorder.hpp"
+
+#include <cassert>
+
+VulkanCommandRecorder::VulkanCommandRecorder()
+    : device(VK_NULL_HANDLE),
+      generation(0),
+      finishedWorkers(0),
+      stopping(false),
+      jobs(NULL),
+      jobCount(0),
+      slot(0),
+      nextJob(0) {}
+
+void VulkanCommandRecorder::init(VkDevice device, uint32_t queueFamily,
+                                 uint32_t frameSlots, uint32_t threadCount,
+                                 bool perBufferReset) {
+  assert(frameSlots >= 1);
+  this->device = device;
+
+  if (threadCount < 1) threadCount = 1;
+
+  workers = std::vector<Worker>(threadCount);
+
+  for (uint32_t i = 0; i < threadCount; i++)
+    workers[i].commands.init(device, queueFamily, frameSlots, perBufferReset);
+
+  stopping = false;
+
+  for (uint32_t i = 1; i < threadCount; i++)
+    workers[i].thread =
+        std::thread(&VulkanCommandRecorder::workerMain, this, i);
+}
+
+void VulkanCommandRecorder::destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (uint32_t i = 1; i < workers.size(); i++) workers[i].thread.join();
+
+  for (uint32_t i = 0; i < workers.size(); i++) workers[i].commands.destroy();
+
+  workers.clear();
+}
+
+void VulkanCommandRecorder::resetSlot(uint32_t slot) {
+  for (uint32_t i = 0; i < workers.size(); i++)
+    workers[i].commands.reset(slot);
+}
+
+void VulkanCommandRecorder::runJobs(uint32_t worker) {
+  VulkanCommandAllocator &commands = workers[worker].commands;
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = NULL;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+
+  if (inheritance.renderPass != VK_NULL_HANDLE)
+    beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+  uint32_t index;
+
+  while ((index = nextJob.fetch_add(1, std::memory_order_relaxed)) <
+         jobCount) {
+    VkCommandBuffer cmdBuffer =
+        commands.allocate(slot, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+    VkResult result = vkd.BeginCommandBuffer(cmdBuffer, &beginInfo);
+    assert(result == VK_SUCCESS);
+
+    jobs[index].record(cmdBuffer, jobs[index].context);
+
+    result = vkd.EndCommandBuffer(cmdBuffer);
+    assert(result == VK_SUCCESS);
+
+    recorded[index] = cmdBuffer;
+  }
+}
+
+void VulkanCommandRecorder::workerMain(uint32_t worker) {
+  uint64_t seen = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+
+      if (stopping) return;
+
+      seen = generation;
+    }
+
+    runJobs(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finishedWorkers++;
+    }
+    done.notify_one();
+  }
+}
+
+void VulkanCommandRecorder::record(
+    VkCommandBuffer primary, uint32_t slot, const RecordJob *jobs,
+    uint32_t jobCount, const VkCommandBufferInheritanceInfo *inheritance) {
+  if (jobCount == 0) return;
+
+  this->jobs = jobs;
+  this->jobCount = jobCount;
+  this->slot = slot;
+
+  if (inheritance != NULL) {
+    this->inheritance = *inheritance;
+  } else {
+    this->inheritance = {};
+    this->inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  }
+
+  if (recorded.size() < jobCount) recorded.resize(jobCount);
+
+  nextJob.store(0, std::memory_order_relaxed);
+
+  // Waking the other threads costs more than a single job is worth.
+  bool parallel = jobCount > 1 && workers.size() > 1;
+
+  if (parallel) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finishedWorkers = 0;
+      generation++;
+    }
+    wake.notify_all();
+  }
+
+  runJobs(0);
+
+  if (parallel) {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint32_t others = (uint32_t)workers.size() - 1;
+    done.wait(lock, [&] { return finishedWorkers == others; });
+  }
+
+  vkd.CmdExecuteCommands(primary, jobCount, recorded.data());
+}
@@ -0,0 +1,81 @@
+#ifndef VULKAN_COMMAND_RECORDER_HPP
+#define VULKAN_COMMAND_RECORDER_HPP
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VulkanCommandAllocator.hpp"
+
+// One unit of recording work. `record` is called with a secondary command
+// buffer that is already begun and is ended once it returns.
+typedef void (*RecordFunc)(VkCommandBuffer cmdBuffer, void *context);
+
+struct RecordJob {
+  RecordFunc record;
+  void *context;
+};
+
+// Records secondary command buffers on a fixed set of threads and stitches
+// them into a primary command buffer with vkCmdExecuteCommands. Command pools
+// are externally synchronized, so every thread owns one pool per frame slot
+// and no pool is ever touched by two threads at once. The calling thread
+// takes part in the recording as worker 0.
+class VulkanCommandRecorder {
+ private:
+  struct Worker {
+    std::thread thread;
+    VulkanCommandAllocator commands;
+  };
+
+  VkDevice device;
+  std::vector<Worker> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  uint64_t generation;
+  uint32_t finishedWorkers;
+  bool stopping;
+
+  // The batch currently being recorded. Only written while the workers are
+  // idle, and published to them through `mutex`.
+  const RecordJob *jobs;
+  uint32_t jobCount;
+  uint32_t slot;
+  VkCommandBufferInheritanceInfo inheritance;
+  std::atomic<uint32_t> nextJob;
+  std::vector<VkCommandBuffer> recorded;
+
+  void workerMain(uint32_t worker);
+  void runJobs(uint32_t worker);
+
+ public:
+  VulkanCommandRecorder();
+
+  // Creates `threadCount` - 1 worker threads, each with `frameSlots` command
+  // pools on `queueFamily`.
+  void init(VkDevice device, uint32_t queueFamily, uint32_t frameSlots,
+            uint32_t threadCount, bool perBufferReset = false);
+  void destroy();
+
+  uint32_t threadCount() const { return (uint32_t)workers.size(); }
+
+  // Recycles every secondary command buffer recorded for `slot`. Only call
+  // once the GPU has finished with them, e.g. after waiting on the slot's
+  // fence.
+  void resetSlot(uint32_t slot);
+
+  // Records `jobs` in parallel and executes the results on `primary` in the
+  // order given. Pass the render pass and framebuffer in `inheritance` when
+  // `primary` is inside a render pass begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+  void record(VkCommandBuffer primary, uint32_t slot, const RecordJob *jobs,
+              uint32_t jobCount,
+              const VkCommandBufferInheritanceInfo *inheritance = NULL);
+};
+
+#endif  // VULKAN_COMMAND_RECORDER_HPP
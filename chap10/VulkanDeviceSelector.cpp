@@ -0,0 +1,284 @@
+#include "VulkanDeviceSelector.hpp"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cassert>
+#include <cstring>
+
+#include "VulkanTools.hpp"
+
+#define DEVICE_TYPE_WEIGHT 1000000
+#define MAX_HEAP_SCORE 500000
+#define ASYNC_COMPUTE_SCORE 64
+#define DEDICATED_TRANSFER_SCORE 32
+
+static int64_t deviceTypeRank(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static const char *deviceTypeName(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return "cpu";
+    default:
+      return "other";
+  }
+}
+
+// Parses 32 hex digits, ignoring dashes, into `uuid`.
+static bool parseUuid(const char *text, uint8_t uuid[VK_UUID_SIZE]) {
+  uint32_t digits = 0;
+
+  for (const char *c = text; *c != '\0'; c++) {
+    if (*c == '-') continue;
+
+    if (!isxdigit((unsigned char)*c) || digits == VK_UUID_SIZE * 2)
+      return false;
+
+    uint8_t value = isdigit((unsigned char)*c)
+                        ? *c - '0'
+                        : tolower((unsigned char)*c) - 'a' + 10;
+
+    if (digits % 2 == 0)
+      uuid[digits / 2] = value << 4;
+    else
+      uuid[digits / 2] |= value;
+
+    digits++;
+  }
+
+  return digits == VK_UUID_SIZE * 2;
+}
+
+static bool containsIgnoringCase(const char *haystack, const char *needle) {
+  size_t length = strlen(needle);
+
+  for (const char *h = haystack; *h != '\0'; h++) {
+    size_t i = 0;
+
+    while (i < length && h[i] != '\0' &&
+           tolower((unsigned char)h[i]) == tolower((unsigned char)needle[i]))
+      i++;
+
+    if (i == length) return true;
+  }
+
+  return false;
+}
+
+void VulkanDeviceSelector::evaluate(VkInstance instance,
+                                    DeviceCandidate &candidate) {
+  VkPhysicalDevice physicalDevice = candidate.physicalDevice;
+  vkGetPhysicalDeviceProperties(physicalDevice, &candidate.properties);
+
+  candidate.hasUuid = false;
+  candidate.rejection = NULL;
+
+#if defined(VK_KHR_external_memory_capabilities)
+  // The device UUID needs VK_KHR_get_physical_device_properties2 and
+  // VK_KHR_external_memory_capabilities on the instance.
+  PFN_vkGetPhysicalDeviceProperties2KHR fpGetPhysicalDeviceProperties2KHR =
+      (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(
+          instance, "vkGetPhysicalDeviceProperties2KHR");
+
+  if (fpGetPhysicalDeviceProperties2KHR != NULL &&
+      VulkanTools::hasInstanceExtension(
+          VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME)) {
+    VkPhysicalDeviceIDPropertiesKHR idProperties = {};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+
+    VkPhysicalDeviceProperties2KHR properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+    properties.pNext = &idProperties;
+    fpGetPhysicalDeviceProperties2KHR(physicalDevice, &properties);
+
+    memcpy(candidate.uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    candidate.hasUuid = true;
+  }
+#endif
+
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  candidate.localHeapSize = 0;
+
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+    const VkMemoryHeap &heap = memoryProperties.memoryHeaps[i];
+
+    if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+        heap.size > candidate.localHeapSize)
+      candidate.localHeapSize = heap.size;
+  }
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                           families.data());
+
+  bool graphics = false;
+  candidate.asyncCompute = false;
+  candidate.dedicatedTransfer = false;
+
+  for (uint32_t i = 0; i < familyCount; i++) {
+    VkQueueFlags flags = families[i].queueFlags;
+
+    if (families[i].queueCount == 0) continue;
+
+    if (flags & VK_QUEUE_GRAPHICS_BIT)
+      graphics = true;
+    else if (flags & VK_QUEUE_COMPUTE_BIT)
+      candidate.asyncCompute = true;
+    else if (flags & VK_QUEUE_TRANSFER_BIT)
+      candidate.dedicatedTransfer = true;
+  }
+
+  if (!graphics)
+    candidate.rejection = "no graphics queue";
+  else if (!VulkanTools::hasDeviceExtension(physicalDevice,
+                                            VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+    candidate.rejection = "no VK_KHR_swapchain";
+
+  // Type dominates, then the heap size in 64 MiB units. The queue bonuses
+  // are worth a few GiB of heap.
+  int64_t heapScore = (int64_t)(candidate.localHeapSize >> 26);
+
+  if (heapScore > MAX_HEAP_SCORE) heapScore = MAX_HEAP_SCORE;
+
+  candidate.score =
+      deviceTypeRank(candidate.properties.deviceType) * DEVICE_TYPE_WEIGHT +
+      heapScore +
+      (candidate.asyncCompute ? ASYNC_COMPUTE_SCORE : 0) +
+      (candidate.dedicatedTransfer ? DEDICATED_TRANSFER_SCORE : 0);
+}
+
+std::vector<DeviceCandidate> VulkanDeviceSelector::evaluateAll(
+    VkInstance instance) {
+  uint32_t deviceCount = 0;
+  VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+  assert(result == VK_SUCCESS);
+
+  if (deviceCount == 0) VulkanTools::exitOnError("No Vulkan devices found");
+
+  std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+  result = vkEnumeratePhysicalDevices(instance, &deviceCount,
+                                      physicalDevices.data());
+  assert(result == VK_SUCCESS);
+
+  std::vector<DeviceCandidate> candidates(deviceCount);
+
+  for (uint32_t i = 0; i < deviceCount; i++) {
+    candidates[i].physicalDevice = physicalDevices[i];
+    evaluate(instance, candidates[i]);
+  }
+
+  return candidates;
+}
+
+bool VulkanDeviceSelector::matches(const DeviceCandidate &candidate,
+                                   uint32_t index, const char *selector) {
+  uint8_t uuid[VK_UUID_SIZE];
+
+  if (parseUuid(selector, uuid))
+    return candidate.hasUuid && memcmp(uuid, candidate.uuid, VK_UUID_SIZE) == 0;
+
+  char *end;
+  unsigned long value = strtoul(selector, &end, 10);
+
+  if (end != selector && *end == '\0') return value == index;
+
+  unsigned int vendorID, deviceID;
+  char trailing;
+
+  if (sscanf(selector, "%x:%x%c", &vendorID, &deviceID, &trailing) == 2)
+    return vendorID == candidate.properties.vendorID &&
+           deviceID == candidate.properties.deviceID;
+
+  return containsIgnoringCase(candidate.properties.deviceName, selector);
+}
+
+uint32_t VulkanDeviceSelector::select(
+    const std::vector<DeviceCandidate> &candidates, const char *selector) {
+  if (selector != NULL && *selector != '\0') {
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+      if (!matches(candidates[i], i, selector)) continue;
+
+      if (candidates[i].rejection != NULL) {
+        fprintf(stderr, "Selected device %s is unusable: %s\n",
+                candidates[i].properties.deviceName, candidates[i].rejection);
+        break;
+      }
+
+      return i;
+    }
+
+    fprintf(stderr, "No usable device matches \"%s\", selecting by score\n",
+            selector);
+  }
+
+  uint32_t best = UINT32_MAX;
+
+  for (uint32_t i = 0; i < candidates.size(); i++) {
+    if (candidates[i].rejection != NULL) continue;
+
+    if (best == UINT32_MAX || candidates[i].score > candidates[best].score)
+      best = i;
+  }
+
+  if (best == UINT32_MAX)
+    VulkanTools::exitOnError("No Vulkan device can run this example");
+
+  return best;
+}
+
+void VulkanDeviceSelector::print(const std::vector<DeviceCandidate> &candidates,
+                                 uint32_t selected) {
+  for (uint32_t i = 0; i < candidates.size(); i++) {
+    const DeviceCandidate &c = candidates[i];
+    const VkPhysicalDeviceProperties &p = c.properties;
+
+    fprintf(stdout, "%s Device %u:     %s\n", i == selected ? "*" : " ", i,
+            p.deviceName);
+    fprintf(stdout, "  Device Type:    %s\n", deviceTypeName(p.deviceType));
+    fprintf(stdout, "  Vendor/Device:  %04x:%04x\n", p.vendorID, p.deviceID);
+    fprintf(stdout, "  Driver Version: %d\n", p.driverVersion);
+    fprintf(stdout, "  API Version:    %d.%d.%d\n",
+            VK_VERSION_MAJOR(p.apiVersion), VK_VERSION_MINOR(p.apiVersion),
+            VK_VERSION_PATCH(p.apiVersion));
+    fprintf(stdout, "  Local Memory:   %llu MiB\n",
+            (unsigned long long)(c.localHeapSize >> 20));
+
+    if (c.hasUuid) {
+      fprintf(stdout, "  UUID:           ");
+
+      for (uint32_t b = 0; b < VK_UUID_SIZE; b++)
+        fprintf(stdout, "%02x", c.uuid[b]);
+
+      fprintf(stdout, "\n");
+    }
+
+    if (c.rejection != NULL)
+      fprintf(stdout, "  Unusable:       %s\n", c.rejection);
+    else
+      fprintf(stdout, "  Score:          %lld\n", (long long)c.score);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef VULKAN_DEVICE_SELECTOR_HPP
+#define VULKAN_DEVICE_SELECTOR_HPP
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Everything the selector looked at for one physical device.
+struct DeviceCandidate {
+  VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceProperties properties;
+  bool hasUuid;
+  uint8_t uuid[VK_UUID_SIZE];
+  VkDeviceSize localHeapSize;
+  bool asyncCompute;
+  bool dedicatedTransfer;
+  // Set when the device cannot run the example at all.
+  const char *rejection;
+  int64_t score;
+};
+
+// Picks the physical device to run on. Usable devices are ranked by type
+// (discrete > integrated > virtual > CPU), then by their largest
+// device-local heap, then by whether they have async compute and transfer
+// queues. The window surface does not exist yet when the device is chosen,
+// so presentation is only checked by requiring VK_KHR_swapchain and a
+// graphics queue; createSurface() verifies the rest.
+//
+// An override such as VK_DEVICE_SELECT picks a device directly by index,
+// by "vendorID:deviceID" in hex, by device UUID or by part of its name.
+class VulkanDeviceSelector {
+ private:
+  static void evaluate(VkInstance instance, DeviceCandidate &candidate);
+  static bool matches(const DeviceCandidate &candidate, uint32_t index,
+                      const char *selector);
+
+ public:
+  static std::vector<DeviceCandidate> evaluateAll(VkInstance instance);
+
+  // Returns the index of the chosen candidate, or exits if none is usable.
+  static uint32_t select(const std::vector<DeviceCandidate> &candidates,
+                         const char *selector);
+
+  static void print(const std::vector<DeviceCandidate> &candidates,
+                    uint32_t selected);
+};
+
+#endif  // VULKAN_DEVICE_SELECTOR_HPP
@@ -0,0 +1,26 @@
+#include "VulkanDeviceTable.hpp"
+
+#include "VulkanTools.hpp"
+
+VulkanDeviceTable vkd;
+
+static PFN_vkVoidFunction getProcAddr(VkInstance instance, VkDevice device,
+                                      bool throughLoader, const char *name) {
+  return throughLoader ? vkGetInstanceProcAddr(instance, name)
+                       : vkGetDeviceProcAddr(device, name);
+}
+
+void VulkanDeviceTable::load(VkInstance instance, VkDevice device,
+                             bool throughLoader) {
+#define VULKAN_DEVICE_TABLE_LOAD(name)                                    \
+  name = (PFN_vk##name)getProcAddr(instance, device, throughLoader,       \
+                                   "vk" #name);                           \
+  if (!name) VulkanTools::exitOnError("Failed to find vk" #name);
+  VULKAN_DEVICE_FUNCTIONS(VULKAN_DEVICE_TABLE_LOAD)
+#undef VULKAN_DEVICE_TABLE_LOAD
+
+#define VULKAN_DEVICE_TABLE_LOAD_OPTIONAL(name) \
+  name = (PFN_vk##name)getProcAddr(instance, device, throughLoader, "vk" #name);
+  VULKAN_OPTIONAL_DEVICE_FUNCTIONS(VULKAN_DEVICE_TABLE_LOAD_OPTIONAL)
+#undef VULKAN_DEVICE_TABLE_LOAD_OPTIONAL
+}
@@ -0,0 +1,88 @@
+#ifndef VULKAN_DEVICE_TABLE_HPP
+#define VULKAN_DEVICE_TABLE_HPP
+
+#include <vulkan/vulkan.h>
+
+// Every device-level entry point the example uses. Calls through the
+// exported vk* symbols go through a loader trampoline that looks up the
+// device's dispatch table on every call; pointers from vkGetDeviceProcAddr
+// go straight to the driver. Add new device functions here rather than
+// calling the vk* symbol.
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+  X(AcquireNextImageKHR)           \
+  X(AllocateCommandBuffers)        \
+  X(AllocateMemory)                \
+  X(BeginCommandBuffer)            \
+  X(BindBufferMemory)              \
+  X(BindImageMemory)               \
+  X(CmdClearColorImage)            \
+  X(CmdCopyBuffer)                 \
+  X(CmdCopyImage)                  \
+  X(CmdExecuteCommands)            \
+  X(CmdPipelineBarrier)            \
+  X(CreateBuffer)                  \
+  X(CreateCommandPool)             \
+  X(CreateFence)                   \
+  X(CreateFramebuffer)             \
+  X(CreateImage)                   \
+  X(CreateImageView)               \
+  X(CreatePipelineCache)           \
+  X(CreateSemaphore)               \
+  X(CreateSwapchainKHR)            \
+  X(DestroyBuffer)                 \
+  X(DestroyCommandPool)            \
+  X(DestroyDevice)                 \
+  X(DestroyFence)                  \
+  X(DestroyFramebuffer)            \
+  X(DestroyImage)                  \
+  X(DestroyImageView)              \
+  X(DestroyPipelineCache)          \
+  X(DestroySemaphore)              \
+  X(DestroySwapchainKHR)           \
+  X(DeviceWaitIdle)                \
+  X(EndCommandBuffer)              \
+  X(FlushMappedMemoryRanges)       \
+  X(FreeCommandBuffers)            \
+  X(FreeMemory)                    \
+  X(GetBufferMemoryRequirements)   \
+  X(GetDeviceQueue)                \
+  X(GetImageMemoryRequirements)    \
+  X(GetPipelineCacheData)          \
+  X(GetSwapchainImagesKHR)         \
+  X(MapMemory)                     \
+  X(QueuePresentKHR)               \
+  X(QueueSubmit)                   \
+  X(QueueWaitIdle)                 \
+  X(ResetCommandBuffer)            \
+  X(ResetCommandPool)              \
+  X(ResetFences)                   \
+  X(WaitForFences)
+
+// Entry points of extensions the example can do without. They are NULL
+// when the device does not expose them.
+#if defined(VK_KHR_synchronization2)
+#define VULKAN_OPTIONAL_DEVICE_FUNCTIONS(X) \
+  X(CmdPipelineBarrier2KHR)                 \
+  X(QueueSubmit2KHR)
+#else
+#define VULKAN_OPTIONAL_DEVICE_FUNCTIONS(X)
+#endif
+
+struct VulkanDeviceTable {
+#define VULKAN_DEVICE_TABLE_ENTRY(name) PFN_vk##name name;
+  VULKAN_DEVICE_FUNCTIONS(VULKAN_DEVICE_TABLE_ENTRY)
+  VULKAN_OPTIONAL_DEVICE_FUNCTIONS(VULKAN_DEVICE_TABLE_ENTRY)
+#undef VULKAN_DEVICE_TABLE_ENTRY
+
+  // Fills the table for `device`. Exits if a required entry point is
+  // missing. With `throughLoader` the entries are the loader trampolines
+  // from vkGetInstanceProcAddr instead, which only exists to measure what
+  // the table saves.
+  void load(VkInstance instance, VkDevice device, bool throughLoader = false);
+};
+
+// The table for the one VkDevice the example creates, filled right after
+// vkCreateDevice.
+extern VulkanDeviceTable vkd;
+
+#endif  // VULKAN_DEVICE_TABLE_HPP
@@ -0,0 +1,160 @@
+#include "VulkanEventPump.hpp"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <stdlib.h>
+
+#define INPUT_POLL_TIMEOUT_MS 4
+
+void WindowEvents::reset() {
+  quit = false;
+  resized = false;
+  pointerMoved = false;
+  keyCount = 0;
+}
+
+void WindowEvents::merge(const WindowEvents &other) {
+  quit = quit || other.quit;
+
+  if (other.resized) {
+    resized = true;
+    width = other.width;
+    height = other.height;
+  }
+
+  if (other.pointerMoved) {
+    pointerMoved = true;
+    pointerX = other.pointerX;
+    pointerY = other.pointerY;
+  }
+
+  for (uint32_t i = 0; i < other.keyCount && keyCount < MAX_KEY_EVENTS; i++)
+    keys[keyCount++] = other.keys[i];
+}
+
+VulkanEventPump::VulkanEventPump()
+    : connection(NULL), threaded(false), stopping(false) {}
+
+void VulkanEventPump::init(xcb_connection_t *connection,
+                           xcb_atom_t wmDeleteWin, uint32_t width,
+                           uint32_t height, bool threaded) {
+  this->connection = connection;
+  this->wmDeleteWin = wmDeleteWin;
+  this->width = width;
+  this->height = height;
+  this->threaded = threaded;
+
+  if (threaded) {
+    stopping.store(false);
+    inputThread = std::thread(&VulkanEventPump::inputThreadMain, this);
+  }
+}
+
+void VulkanEventPump::shutdown() {
+  if (!threaded) return;
+
+  stopping.store(true, std::memory_order_release);
+  inputThread.join();
+  threaded = false;
+}
+
+bool VulkanEventPump::drain(WindowEvents &events) {
+  bool received = false;
+  xcb_generic_event_t *event;
+
+  while ((event = xcb_poll_for_event(connection)) != NULL) {
+    received = true;
+
+    switch (event->response_type & ~0x80) {
+      case XCB_CLIENT_MESSAGE: {
+        xcb_client_message_event_t *cm = (xcb_client_message_event_t *)event;
+
+        if (cm->data.data32[0] == wmDeleteWin) events.quit = true;
+
+        break;
+      }
+      case XCB_DESTROY_NOTIFY:
+        events.quit = true;
+        break;
+      case XCB_CONFIGURE_NOTIFY: {
+        // Moving the window also sends ConfigureNotify; only size changes
+        // are interesting to the renderer.
+        xcb_configure_notify_event_t *cfg =
+            (xcb_configure_notify_event_t *)event;
+
+        if (cfg->width != width || cfg->height != height) {
+          width = cfg->width;
+          height = cfg->height;
+          events.resized = true;
+          events.width = width;
+          events.height = height;
+        }
+
+        break;
+      }
+      case XCB_MOTION_NOTIFY: {
+        xcb_motion_notify_event_t *motion = (xcb_motion_notify_event_t *)event;
+        events.pointerMoved = true;
+        events.pointerX = motion->event_x;
+        events.pointerY = motion->event_y;
+        break;
+      }
+      case XCB_KEY_PRESS: {
+        xcb_key_press_event_t *key = (xcb_key_press_event_t *)event;
+
+        if (events.keyCount < MAX_KEY_EVENTS)
+          events.keys[events.keyCount++] = key->detail;
+
+        break;
+      }
+    }
+
+    free(event);
+  }
+
+  if (xcb_connection_has_error(connection)) {
+    events.quit = true;
+    received = true;
+  }
+
+  return received;
+}
+
+void VulkanEventPump::inputThreadMain() {
+  WindowEvents pending = {};
+  pending.width = width;
+  pending.height = height;
+
+  bool hasPending = false;
+  struct pollfd pfd = {};
+  pfd.fd = xcb_get_file_descriptor(connection);
+  pfd.events = POLLIN;
+
+  while (!stopping.load(std::memory_order_acquire)) {
+    bool received = drain(pending);
+    hasPending = hasPending || received;
+
+    // If the render thread has fallen behind and the queue is full, keep
+    // folding new events into the pending batch and try again later.
+    if (hasPending && queue.push(pending)) {
+      pending.reset();
+      hasPending = false;
+    }
+
+    if (!received) poll(&pfd, 1, INPUT_POLL_TIMEOUT_MS);
+  }
+}
+
+void VulkanEventPump::pump(WindowEvents &events) {
+  events.reset();
+
+  if (!threaded) {
+    drain(events);
+    return;
+  }
+
+  WindowEvents batch;
+
+  while (queue.pop(batch)) events.merge(batch);
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef VULKAN_EVENT_PUMP_HPP
+#define VULKAN_EVENT_PUMP_HPP
+
+#if defined(__linux__)
+#include <stdint.h>
+#include <xcb/xcb.h>
+#include <atomic>
+#include <thread>
+
+#define MAX_KEY_EVENTS 16
+#define EVENT_QUEUE_SIZE 64
+
+// Everything that happened to the window since the last pump, with repeated
+// events already collapsed: only the final size and pointer position survive.
+struct WindowEvents {
+  bool quit;
+  bool resized;
+  uint32_t width;
+  uint32_t height;
+  bool pointerMoved;
+  int32_t pointerX;
+  int32_t pointerY;
+  uint32_t keyCount;
+  xcb_keycode_t keys[MAX_KEY_EVENTS];
+
+  void reset();
+  void merge(const WindowEvents &other);
+};
+
+// Single-producer, single-consumer ring buffer. Neither side ever blocks; a
+// full queue makes push() fail so the producer can keep coalescing locally.
+template <typename T, uint32_t Capacity>
+class SpscQueue {
+ private:
+  T items[Capacity];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+
+ public:
+  SpscQueue() : head(0), tail(0) {}
+
+  bool push(const T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t next = (t + 1) % Capacity;
+
+    if (next == head.load(std::memory_order_acquire)) return false;
+
+    items[t] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load(std::memory_order_acquire)) return false;
+
+    item = items[h];
+    head.store((h + 1) % Capacity, std::memory_order_release);
+    return true;
+  }
+};
+
+class VulkanEventPump {
+ private:
+  xcb_connection_t *connection;
+  xcb_atom_t wmDeleteWin;
+  uint32_t width;
+  uint32_t height;
+
+  bool threaded;
+  std::thread inputThread;
+  std::atomic<bool> stopping;
+  SpscQueue<WindowEvents, EVENT_QUEUE_SIZE> queue;
+
+  bool drain(WindowEvents &events);
+  void inputThreadMain();
+
+ public:
+  VulkanEventPump();
+
+  void init(xcb_connection_t *connection, xcb_atom_t wmDeleteWin,
+            uint32_t width, uint32_t height, bool threaded);
+  void shutdown();
+
+  // Collects everything that arrived since the previous call. Never blocks,
+  // whether events are read here or on the input thread.
+  void pump(WindowEvents &events);
+};
+#endif
+
+#endif  // VULKAN_EVENT_PUMP_HPP
@@ -1,5 +1,55 @@
 #include "VulkanExample.hpp"
 
+#if defined(__linux__)
+#include <signal.h>
+#endif
+
+static void recordClear(VkCommandBuffer cmdBuffer, void *context) {
+  const ClearJob *job = (const ClearJob *)context;
+
+  VkImageSubresourceRange range = {};
+  range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  range.baseMipLevel = 0;
+  range.levelCount = 1;
+  range.baseArrayLayer = 0;
+  range.layerCount = 1;
+
+  vkd.CmdClearColorImage(cmdBuffer, job->image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &job->color, 1,
+                         &range);
+}
+
+static void recordTiles(VkCommandBuffer cmdBuffer, void *context) {
+  const TileJob *job = (const TileJob *)context;
+
+  VkImageCopy region = {};
+  region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.srcSubresource.mipLevel = 0;
+  region.srcSubresource.baseArrayLayer = 0;
+  region.srcSubresource.layerCount = 1;
+  region.dstSubresource = region.srcSubresource;
+  region.dstOffset.y = (int32_t)job->y;
+  region.extent.height = job->extent.height - job->y < RECORD_TILE_SIZE
+                             ? job->extent.height - job->y
+                             : RECORD_TILE_SIZE;
+  region.extent.depth = 1;
+
+  for (uint32_t x = job->firstX; x < job->extent.width;
+       x += 2 * RECORD_TILE_SIZE) {
+    region.dstOffset.x = (int32_t)x;
+    region.extent.width = job->extent.width - x < RECORD_TILE_SIZE
+                              ? job->extent.width - x
+                              : RECORD_TILE_SIZE;
+    vkd.CmdCopyImage(cmdBuffer, job->overlay,
+                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, job->image,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  }
+}
+
+#if defined(__linux__)
+static void onStatsSignal(int) { hostAllocator.requestStats(); }
+#endif
+
 VulkanExample::VulkanExample() {
 #if defined(_WIN32)
   AllocConsole();
@@ -7,12 +57,75 @@ VulkanExample::VulkanExample() {
   freopen("CON", "w", stdout);
   SetConsoleTitle(TEXT(APPLICATION_NAME));
 #endif
+  framesInFlight =
+      VulkanTools::getEnvUint("VK_FRAMES_IN_FLIGHT", FRAMES_IN_FLIGHT);
+
+  if (framesInFlight < 1) framesInFlight = 1;
+
+  if (framesInFlight > MAX_FRAMES_IN_FLIGHT)
+    framesInFlight = MAX_FRAMES_IN_FLIGHT;
+
+  frameIndex = 0;
+  frameNumber = 0;
+  acquireTimeout =
+      VulkanTools::getEnvUint("VK_ACQUIRE_TIMEOUT_MS", ACQUIRE_TIMEOUT_MS) *
+      1000000ULL;
+  staticContent = VulkanTools::getEnvUint("VK_STATIC_CONTENT", 0) != 0;
+  contentVersion = 1;
+  resizePending = false;
+  resizeWidth = WINDOW_WIDTH;
+  resizeHeight = WINDOW_HEIGHT;
+  frameLimit = VulkanTools::getEnvUint("VK_FRAME_LIMIT", 0);
+  lastAllocationCount = 0;
+  steadyAllocations = 0;
+  allocatingFrames = 0;
+
+  if (VulkanTools::getEnvUint("VK_ALLOCATION_CHECK", 0) != 0)
+    VulkanAllocationCounter::enable();
+
+  VulkanLoader::overrideDriver(getenv("VK_ICD_JSON"));
+  hostAllocator.init(VulkanTools::getEnvUint("VK_HOST_ALLOCATOR", 1) != 0);
+#if defined(__linux__)
+  signal(SIGUSR1, onStatsSignal);
+#endif
+
+  // Nothing up to surface creation needs the window, so the instance and
+  // device are created while createWindow() waits on the X server.
+  if (VulkanTools::getEnvUint("VK_SERIAL_INIT", 0) != 0)
+    initVulkan();
+  else
+    initThread = std::thread(&VulkanExample::initVulkan, this);
+}
+
+VulkanExample::~VulkanExample() {
+  waitForVulkan();
+  vkd.DestroyCommandPool(device, cmdPool,
+                         hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL));
+  vkd.DestroyDevice(device, hostAllocator.callbacks(HOST_OBJECT_DEVICE));
+  swapchain.destroySurface();
+  vkDestroyInstance(instance, hostAllocator.callbacks(HOST_OBJECT_INSTANCE));
+  hostAllocator.printStats(stdout);
+}
+
+void VulkanExample::initVulkan() {
+  {
+    StartupPhase phase("Vulkan loader");
+    VulkanLoader::init(getenv("VK_LOADER_LIBRARY"));
+  }
+
   createInstance();
   initDevices();
-  swapchain.init(instance, physicalDevice, device);
+  swapchain.init(instance, physicalDevice, device, queueFamilies.graphics);
+  swapchain.setPresentProfile(
+      VulkanSwapchain::parsePresentProfile(getenv("VK_PRESENT_PROFILE")));
 }
 
-VulkanExample::~VulkanExample() { vkDestroyInstance(instance, NULL); }
+void VulkanExample::waitForVulkan() {
+  if (!initThread.joinable()) return;
+
+  StartupPhase phase("wait for Vulkan init");
+  initThread.join();
+}
 
 void VulkanExample::createInstance() {
   VkApplicationInfo appInfo = {};
@@ -32,6 +145,20 @@ void VulkanExample::createInstance() {
   enabledExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
 #endif
 
+  // Needed to query optional device features such as synchronization2.
+  if (VulkanTools::hasInstanceExtension(
+          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    enabledExtensions.push_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+#if defined(VK_KHR_external_memory_capabilities)
+  // Exposes device UUIDs for VK_DEVICE_SELECT.
+  if (VulkanTools::hasInstanceExtension(
+          VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME))
+    enabledExtensions.push_back(
+        VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME);
+#endif
+
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   createInfo.pNext = NULL;
@@ -40,7 +167,12 @@ void VulkanExample::createInstance() {
   createInfo.enabledExtensionCount = enabledExtensions.size();
   createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
-  VkResult res = vkCreateInstance(&createInfo, NULL, &instance);
+  uint32_t phase = startupTimer.begin("vkCreateInstance");
+  VkResult res =
+      vkCreateInstance(&createInfo,
+                       hostAllocator.callbacks(HOST_OBJECT_INSTANCE),
+                       &instance);
+  startupTimer.end(phase);
 
   if (res == VK_ERROR_INCOMPATIBLE_DRIVER) {
     VulkanTools::exitOnError(
@@ -53,58 +185,101 @@ void VulkanExample::createInstance() {
       "you have a Vulkan installable client driver (ICD) before "
       "continuing.");
   }
+
+  VulkanLoader::loadInstance(instance);
 }
 
 void VulkanExample::initDevices() {
-  uint32_t deviceCount = 0;
-  VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
-  assert(result == VK_SUCCESS);
-  assert(deviceCount >= 1);
+  uint32_t phase = startupTimer.begin("device enumeration");
+  std::vector<DeviceCandidate> candidates =
+      VulkanDeviceSelector::evaluateAll(instance);
+  uint32_t selected =
+      VulkanDeviceSelector::select(candidates, getenv("VK_DEVICE_SELECT"));
+  startupTimer.end(phase);
 
-  std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+  VulkanDeviceSelector::print(candidates, selected);
+  physicalDevice = candidates[selected].physicalDevice;
 
-  result = vkEnumeratePhysicalDevices(instance, &deviceCount,
-                                      physicalDevices.data());
-  assert(result == VK_SUCCESS);
-
-  physicalDevice = physicalDevices[0];
+  // Extra queues for async compute and transfers when they have families
+  // of their own, so that work can run beside graphics.
+  queueFamilies = VulkanTools::findQueueFamilies(physicalDevice);
+  uint32_t families[] = {queueFamilies.graphics, queueFamilies.compute,
+                         queueFamilies.transfer};
 
   float priorities[] = {1.0f};
-  VkDeviceQueueCreateInfo queueInfo{};
-  queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueInfo.pNext = NULL;
-  queueInfo.flags = 0;
-  queueInfo.queueFamilyIndex = 0;
-  queueInfo.queueCount = 1;
-  queueInfo.pQueuePriorities = &priorities[0];
+  std::vector<VkDeviceQueueCreateInfo> queueInfos;
+
+  for (uint32_t i = 0; i < 3; i++) {
+    bool created = false;
+
+    for (uint32_t j = 0; j < queueInfos.size(); j++)
+      created = created || queueInfos[j].queueFamilyIndex == families[i];
+
+    if (created) continue;
+
+    VkDeviceQueueCreateInfo queueInfo{};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.pNext = NULL;
+    queueInfo.flags = 0;
+    queueInfo.queueFamilyIndex = families[i];
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priorities[0];
+    queueInfos.push_back(queueInfo);
+  }
 
   std::vector<const char *> enabledExtensions = {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME};
   VkDeviceCreateInfo deviceInfo{};
   deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   deviceInfo.pNext = NULL;
+
+  bool useSync2 = VulkanTools::getEnvUint("VK_SYNC2", 1) != 0 &&
+                  VulkanSync::isSupported(instance, physicalDevice);
+
+#if defined(VK_KHR_synchronization2)
+  VkPhysicalDeviceSynchronization2FeaturesKHR sync2Features = {};
+  sync2Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+  sync2Features.synchronization2 = VK_TRUE;
+
+  if (useSync2) {
+    enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    deviceInfo.pNext = &sync2Features;
+  }
+#endif
+
   deviceInfo.flags = 0;
-  deviceInfo.queueCreateInfoCount = 1;
-  deviceInfo.pQueueCreateInfos = &queueInfo;
+  deviceInfo.queueCreateInfoCount = queueInfos.size();
+  deviceInfo.pQueueCreateInfos = queueInfos.data();
   deviceInfo.enabledExtensionCount = enabledExtensions.size();
   deviceInfo.ppEnabledExtensionNames = enabledExtensions.data();
   deviceInfo.pEnabledFeatures = NULL;
 
-  result = vkCreateDevice(physicalDevice, &deviceInfo, NULL, &device);
+  phase = startupTimer.begin("vkCreateDevice");
+  VkResult result = vkCreateDevice(physicalDevice, &deviceInfo,
+                                   hostAllocator.callbacks(HOST_OBJECT_DEVICE),
+                                   &device);
   assert(result == VK_SUCCESS);
+  startupTimer.end(phase);
 
-  VkPhysicalDeviceProperties physicalProperties = {};
-
-  for (uint32_t i = 0; i < deviceCount; i++) {
-    vkGetPhysicalDeviceProperties(physicalDevices[i], &physicalProperties);
-    fprintf(stdout, "Device Name:    %s\n", physicalProperties.deviceName);
-    fprintf(stdout, "Device Type:    %d\n", physicalProperties.deviceType);
-    fprintf(stdout, "Driver Version: %d\n", physicalProperties.driverVersion);
-    fprintf(stdout, "API Version:    %d.%d.%d\n",
-            VK_VERSION_MAJOR(physicalProperties.apiVersion),
-            VK_VERSION_MINOR(physicalProperties.apiVersion),
-            VK_VERSION_PATCH(physicalProperties.apiVersion));
-  }
+  bool loaderDispatch = VulkanTools::getEnvUint("VK_LOADER_DISPATCH", 0) != 0;
+  vkd.load(instance, device, loaderDispatch);
+
+  sync.init(useSync2);
+  memoryAllocator.init(physicalDevice, device);
+
+  // Nothing creates pipelines yet; the cache is ready for when they do.
+  phase = startupTimer.begin("pipeline cache load");
+  pipelineCache.init(device, candidates[selected].properties,
+                     getenv("VK_PIPELINE_CACHE_DIR"),
+                     VulkanTools::getEnvUint("VK_PIPELINE_CACHE", 1) != 0);
+  startupTimer.end(phase);
+
+  fprintf(stdout, "Synchronization2: %s\n",
+          sync.usingSync2() ? "enabled" : "not used");
+  fprintf(stdout, "Queue families: graphics %u, compute %u, transfer %u\n",
+          queueFamilies.graphics, queueFamilies.compute,
+          queueFamilies.transfer);
 }
 
 void VulkanExample::createCommandPool() {
@@ -112,9 +287,22 @@ void VulkanExample::createCommandPool() {
   cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   cmdPoolInfo.pNext = NULL;
   cmdPoolInfo.queueFamilyIndex = swapchain.queueIndex;
+  cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  VkResult result =
+      vkd.CreateCommandPool(device, &cmdPoolInfo,
+                            hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL),
+                            &cmdPool);
+  assert(result == VK_SUCCESS);
+
+  // Static content re-records its draw buffers in place, which needs a pool
+  // that allows individual resets and is not marked short-lived.
   cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-  VkResult result = vkCreateCommandPool(device, &cmdPoolInfo, NULL, &cmdPool);
+  result =
+      vkd.CreateCommandPool(device, &cmdPoolInfo,
+                            hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL),
+                            &drawPool);
   assert(result == VK_SUCCESS);
 }
 
@@ -126,7 +314,8 @@ void VulkanExample::createCommandBuffer() {
   cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
   cmdInfo.commandBufferCount = 1;
 
-  VkResult result = vkAllocateCommandBuffers(device, &cmdInfo, &initialCmdBuffer);
+  VkResult result =
+      vkd.AllocateCommandBuffers(device, &cmdInfo, &initialCmdBuffer);
   assert(result == VK_SUCCESS);
 }
 
@@ -136,16 +325,872 @@ void VulkanExample::beginCommandBuffer() {
   cmdInfo.flags = 0;
   cmdInfo.pNext = NULL;
 
-  VkResult result = vkBeginCommandBuffer(initialCmdBuffer, &cmdInfo);
+  VkResult result = vkd.BeginCommandBuffer(initialCmdBuffer, &cmdInfo);
+  assert(result == VK_SUCCESS);
+}
+
+void VulkanExample::submitCommandBuffer() {
+  VkResult result = vkd.EndCommandBuffer(initialCmdBuffer);
+  assert(result == VK_SUCCESS);
+
+  SubmitBatch batch;
+  batch.reset();
+  batch.addCommandBuffer(initialCmdBuffer);
+
+  result = sync.submit(queue, &batch, 1, VK_NULL_HANDLE);
+  assert(result == VK_SUCCESS);
+
+  result = vkd.QueueWaitIdle(queue);
+  assert(result == VK_SUCCESS);
+}
+
+void VulkanExample::createFrames() {
+  frames.resize(framesInFlight);
+
+  // Frame command buffers come from frameCommands each frame.
+  bool perBufferReset = VulkanTools::getEnvUint("VK_PER_BUFFER_RESET", 0) != 0;
+  frameCommands.init(device, swapchain.queueIndex, framesInFlight,
+                     perBufferReset);
+
+  // Fences start signaled so the first wait on each frame slot returns
+  // immediately.
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.pNext = NULL;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = NULL;
+  semaphoreInfo.flags = 0;
+
+  // Static content replays pre-recorded buffers and draws no overlay.
+  VkImageCreateInfo overlayInfo = {};
+  overlayInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  overlayInfo.pNext = NULL;
+  overlayInfo.flags = 0;
+  overlayInfo.imageType = VK_IMAGE_TYPE_2D;
+  overlayInfo.format = swapchain.colorFormat;
+  overlayInfo.extent = {COMPUTE_OVERLAY_SIZE, COMPUTE_OVERLAY_SIZE, 1};
+  overlayInfo.mipLevels = 1;
+  overlayInfo.arrayLayers = 1;
+  overlayInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  overlayInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  overlayInfo.usage =
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  overlayInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  overlayInfo.queueFamilyIndexCount = 0;
+  overlayInfo.pQueueFamilyIndices = NULL;
+  overlayInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    frames[i].cmdBuffer = VK_NULL_HANDLE;
+    frames[i].uploadCmdBuffer = VK_NULL_HANDLE;
+    frames[i].computeCmdBuffer = VK_NULL_HANDLE;
+    frames[i].overlay = VK_NULL_HANDLE;
+
+    VkResult result =
+        vkd.CreateFence(device, &fenceInfo,
+                        hostAllocator.callbacks(HOST_OBJECT_FENCE),
+                        &frames[i].fence);
+    assert(result == VK_SUCCESS);
+
+    result = vkd.CreateSemaphore(device, &semaphoreInfo,
+                                 hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE),
+                                 &frames[i].imageAvailable);
+    assert(result == VK_SUCCESS);
+
+    result = vkd.CreateSemaphore(device, &semaphoreInfo,
+                                 hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE),
+                                 &frames[i].renderFinished);
+    assert(result == VK_SUCCESS);
+
+    result = vkd.CreateSemaphore(device, &semaphoreInfo,
+                                 hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE),
+                                 &frames[i].uploadDone);
+    assert(result == VK_SUCCESS);
+
+    result = vkd.CreateSemaphore(device, &semaphoreInfo,
+                                 hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE),
+                                 &frames[i].computeDone);
+    assert(result == VK_SUCCESS);
+
+    if (staticContent) continue;
+
+    result = vkd.CreateImage(device, &overlayInfo,
+                             hostAllocator.callbacks(HOST_OBJECT_IMAGE),
+                             &frames[i].overlay);
+    assert(result == VK_SUCCESS);
+
+    frames[i].overlayMemory = memoryAllocator.allocateImage(
+        frames[i].overlay, VK_IMAGE_TILING_OPTIMAL,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    imageTracker.track(frames[i].overlay, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1,
+                       VK_IMAGE_LAYOUT_UNDEFINED, queueFamilies.compute);
+  }
+
+  statsStart = std::chrono::steady_clock::now();
+  statsWaitTime = std::chrono::steady_clock::duration::zero();
+  statsFrames = 0;
+  statsSkipped = 0;
+
+  fprintf(stdout, "Frames in flight: %u, command reset: %s\n", framesInFlight,
+          perBufferReset ? "per buffer" : "per pool");
+}
+
+void VulkanExample::destroyFrames() {
+  for (uint32_t i = 0; i < frames.size(); i++) {
+    vkd.DestroyFence(device, frames[i].fence,
+                     hostAllocator.callbacks(HOST_OBJECT_FENCE));
+    vkd.DestroySemaphore(device, frames[i].imageAvailable,
+                         hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE));
+    vkd.DestroySemaphore(device, frames[i].renderFinished,
+                         hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE));
+    vkd.DestroySemaphore(device, frames[i].uploadDone,
+                         hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE));
+    vkd.DestroySemaphore(device, frames[i].computeDone,
+                         hostAllocator.callbacks(HOST_OBJECT_SEMAPHORE));
+
+    if (frames[i].overlay == VK_NULL_HANDLE) continue;
+
+    imageTracker.forget(frames[i].overlay);
+    vkd.DestroyImage(device, frames[i].overlay,
+                     hostAllocator.callbacks(HOST_OBJECT_IMAGE));
+    memoryAllocator.free(frames[i].overlayMemory);
+  }
+
+  frames.clear();
+  frameCommands.destroy();
+}
+
+void VulkanExample::recordFrame(FrameData &frame, uint32_t imageIndex) {
+  VkCommandBufferBeginInfo cmdInfo = {};
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmdInfo.pNext = NULL;
+  cmdInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult result = vkd.BeginCommandBuffer(frame.cmdBuffer, &cmdInfo);
+  assert(result == VK_SUCCESS);
+
+  VkImage image = swapchain.buffers[imageIndex].image;
+
+  if (frame.computeCmdBuffer == VK_NULL_HANDLE)
+    recordOverlay(frame.cmdBuffer, frame);
+
+  // The whole image is cleared, so its previous contents can be discarded.
+  // Marking the image as acquired makes the transition chain off the stage
+  // the acquire semaphore is waited on.
+  imageTracker.acquired(image, ACQUIRE_WAIT_STAGE);
+  imageTracker.require(barriers, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       true);
+
+  // The second half of the ownership transfer started by
+  // recordTransferUploads().
+  if (frame.uploadCmdBuffer != VK_NULL_HANDLE)
+    barriers.addBufferAcquire(uploadTarget, frameIndex * uploadStressBytes,
+                              uploadStressBytes, queueFamilies.transfer,
+                              queueFamilies.graphics,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_ACCESS_TRANSFER_READ_BIT);
+
+  barriers.flush(frame.cmdBuffer, &sync);
+
+  if (uploadStressBytes > 0 && transferQueue == queue)
+    recordUploadStress(frame.cmdBuffer);
+
+  // Barriers stay on the primary since the tracker is not thread-safe; the
+  // commands in between are recorded by the worker threads.
+  float phase = (float)(frameNumber % 256) / 255.0f;
+  clearJob.image = image;
+  clearJob.color = {{0.0f, phase, 1.0f - phase, 1.0f}};
+
+  RecordJob jobs[] = {{recordClear, &clearJob}};
+  recorder.record(frame.cmdBuffer, frameIndex, jobs, 1);
+
+  // The overlay tiles go on top of the clear. The compute queue released
+  // the overlay to this one if it was cleared there.
+  if (frame.computeCmdBuffer != VK_NULL_HANDLE)
+    imageTracker.acquire(barriers, frame.overlay,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_TRANSFER_READ_BIT);
+  else
+    imageTracker.require(barriers, frame.overlay,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+  imageTracker.require(barriers, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  barriers.flush(frame.cmdBuffer, &sync);
+
+  uint32_t rows =
+      (swapchain.extent.height + RECORD_TILE_SIZE - 1) / RECORD_TILE_SIZE;
+
+  if (tileJobs.size() < rows) {
+    tileJobs.resize(rows);
+    tileRecordJobs.resize(rows);
+  }
+
+  for (uint32_t row = 0; row < rows; row++) {
+    TileJob &tile = tileJobs[row];
+    tile.overlay = frame.overlay;
+    tile.image = image;
+    tile.extent = swapchain.extent;
+    tile.y = row * RECORD_TILE_SIZE;
+    tile.firstX = (row % 2) * RECORD_TILE_SIZE;
+    tileRecordJobs[row].record = recordTiles;
+    tileRecordJobs[row].context = &tile;
+  }
+
+  recorder.record(frame.cmdBuffer, frameIndex, tileRecordJobs.data(), rows);
+
+  imageTracker.require(barriers, image, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  barriers.flush(frame.cmdBuffer, &sync);
+
+  result = vkd.EndCommandBuffer(frame.cmdBuffer);
+  assert(result == VK_SUCCESS);
+}
+
+void VulkanExample::createUploads() {
+  uploadRing.init(
+      physicalDevice, device, memoryAllocator,
+      (VkDeviceSize)VulkanTools::getEnvUint("VK_UPLOAD_RING_MB",
+                                            UPLOAD_RING_SIZE >> 20)
+          << 20,
+      framesInFlight,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  uploadStressBytes =
+      (VkDeviceSize)VulkanTools::getEnvUint("VK_UPLOAD_STRESS_MB", 0) << 20;
+  uploadTarget = VK_NULL_HANDLE;
+
+  if (uploadStressBytes == 0) return;
+
+  if (staticContent) {
+    fprintf(stdout, "Upload stress needs per-frame recording, disabled\n");
+    uploadStressBytes = 0;
+    return;
+  }
+
+  // Every frame in flight keeps its uploads until its fence signals, and
+  // skipping the tail of the ring when wrapping can waste up to one more.
+  VkDeviceSize limit = (uploadRing.size() / (framesInFlight + 1)) & ~255ULL;
+
+  if (uploadStressBytes > limit) uploadStressBytes = limit;
+
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.pNext = NULL;
+  bufferInfo.flags = 0;
+  bufferInfo.size = uploadStressBytes * framesInFlight;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  bufferInfo.queueFamilyIndexCount = 0;
+  bufferInfo.pQueueFamilyIndices = NULL;
+
+  VkResult result =
+      vkd.CreateBuffer(device, &bufferInfo,
+                       hostAllocator.callbacks(HOST_OBJECT_BUFFER),
+                       &uploadTarget);
+  assert(result == VK_SUCCESS);
+
+  uploadTargetMemory = memoryAllocator.allocateBuffer(
+      uploadTarget, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  fprintf(stdout, "Upload stress: %llu KiB per frame through a %llu MiB ring\n",
+          (unsigned long long)(uploadStressBytes >> 10),
+          (unsigned long long)(uploadRing.size() >> 20));
+}
+
+// Returns false when the ring had no room and the frame's uploads were
+// skipped.
+bool VulkanExample::recordUploadStress(VkCommandBuffer cmdBuffer) {
+  VkDeviceSize offset;
+  void *data = uploadRing.allocate(uploadStressBytes, 16, offset);
+
+  if (data == NULL) return false;
+
+  memset(data, (int)(frameNumber & 0xff), uploadStressBytes);
+
+  // The last frame in this slot copied into the same region.
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkd.CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                         NULL, 0, NULL);
+
+  VkBufferCopy region = {offset, frameIndex * uploadStressBytes,
+                         uploadStressBytes};
+  vkd.CmdCopyBuffer(cmdBuffer, uploadRing.handle(), uploadTarget, 1, &region);
+  return true;
+}
+
+void VulkanExample::recordTransferUploads(FrameData &frame) {
+  // Covered by the frame's fence, since the frame waited on uploadDone.
+  transferCommands.reset(frameIndex);
+  VkCommandBuffer cmdBuffer = transferCommands.allocate(frameIndex);
+
+  VkCommandBufferBeginInfo cmdInfo = {};
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmdInfo.pNext = NULL;
+  cmdInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult result = vkd.BeginCommandBuffer(cmdBuffer, &cmdInfo);
+  assert(result == VK_SUCCESS);
+
+  bool recorded = recordUploadStress(cmdBuffer);
+
+  // The copied region changes hands so the graphics queue can use it.
+  if (recorded) {
+    barriers.addBufferRelease(uploadTarget, frameIndex * uploadStressBytes,
+                              uploadStressBytes, queueFamilies.transfer,
+                              queueFamilies.graphics,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              VK_ACCESS_TRANSFER_WRITE_BIT);
+    barriers.flush(cmdBuffer, &sync);
+  }
+
+  result = vkd.EndCommandBuffer(cmdBuffer);
+  assert(result == VK_SUCCESS);
+
+  if (recorded) frame.uploadCmdBuffer = cmdBuffer;
+}
+
+// Clears the slot's overlay for recordFrame() to copy from. The frame that
+// last copied from it has completed, so the queue clearing it takes it over
+// without an ownership transfer back from graphics.
+void VulkanExample::recordOverlay(VkCommandBuffer cmdBuffer,
+                                  FrameData &frame) {
+  imageTracker.claim(frame.overlay, queueFamilies.compute);
+  imageTracker.require(barriers, frame.overlay,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true);
+  barriers.flush(cmdBuffer, &sync);
+
+  float phase = (float)(frameNumber % 256) / 255.0f;
+  VkClearColorValue color = {{1.0f - phase, 0.5f * phase, 0.2f, 1.0f}};
+
+  VkImageSubresourceRange range = {};
+  range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  range.baseMipLevel = 0;
+  range.levelCount = 1;
+  range.baseArrayLayer = 0;
+  range.layerCount = 1;
+
+  vkd.CmdClearColorImage(cmdBuffer, frame.overlay,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1,
+                         &range);
+}
+
+void VulkanExample::recordComputeOverlay(FrameData &frame) {
+  // Covered by the frame's fence, since the frame waited on computeDone.
+  computeCommands.reset(frameIndex);
+  VkCommandBuffer cmdBuffer = computeCommands.allocate(frameIndex);
+
+  VkCommandBufferBeginInfo cmdInfo = {};
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmdInfo.pNext = NULL;
+  cmdInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult result = vkd.BeginCommandBuffer(cmdBuffer, &cmdInfo);
+  assert(result == VK_SUCCESS);
+
+  recordOverlay(cmdBuffer, frame);
+
+  // The overlay changes hands so the graphics queue can copy from it.
+  imageTracker.release(barriers, frame.overlay, queueFamilies.graphics,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  barriers.flush(cmdBuffer, &sync);
+
+  result = vkd.EndCommandBuffer(cmdBuffer);
+  assert(result == VK_SUCCESS);
+
+  frame.computeCmdBuffer = cmdBuffer;
+}
+
+void VulkanExample::destroyUploads() {
+  if (uploadTarget != VK_NULL_HANDLE) {
+    vkd.DestroyBuffer(device, uploadTarget,
+                      hostAllocator.callbacks(HOST_OBJECT_BUFFER));
+    memoryAllocator.free(uploadTargetMemory);
+    uploadTarget = VK_NULL_HANDLE;
+  }
+
+  uploadRing.destroy();
+}
+
+void VulkanExample::resetDrawBuffers() {
+  // Buffers recorded against the old images may still be executing, so they
+  // are freed once the current frame has completed.
+  for (uint32_t i = 0; i < drawBuffers.size(); i++) {
+    if (drawBuffers[i] == VK_NULL_HANDLE) continue;
+
+    RetiredCommandBuffer retired = {drawBuffers[i], frameNumber};
+    retiredDrawBuffers.push_back(retired);
+  }
+
+  drawBuffers.assign(swapchain.imageCount, VK_NULL_HANDLE);
+  drawBufferVersions.assign(swapchain.imageCount, 0);
+  imageFences.assign(swapchain.imageCount, VK_NULL_HANDLE);
+}
+
+void VulkanExample::recordDrawBuffer(uint32_t imageIndex) {
+  VkCommandBuffer &cmdBuffer = drawBuffers[imageIndex];
+
+  VkResult result;
+
+  // The caller has waited for the last frame that used this image, so the
+  // old recording is no longer pending and the buffer can be reset.
+  if (cmdBuffer != VK_NULL_HANDLE) {
+    result = vkd.ResetCommandBuffer(cmdBuffer, 0);
+    assert(result == VK_SUCCESS);
+  } else {
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.pNext = NULL;
+    allocInfo.commandPool = drawPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    result = vkd.AllocateCommandBuffers(device, &allocInfo, &cmdBuffer);
+    assert(result == VK_SUCCESS);
+  }
+
+  VkCommandBufferBeginInfo cmdInfo = {};
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmdInfo.pNext = NULL;
+  cmdInfo.flags = 0;
+
+  result = vkd.BeginCommandBuffer(cmdBuffer, &cmdInfo);
+  assert(result == VK_SUCCESS);
+
+  // Every replay starts from whatever the presentation engine left behind,
+  // so the transitions are recorded from UNDEFINED rather than taken from
+  // the tracker.
+  VkImage image = swapchain.buffers[imageIndex].image;
+  barriers.addImageLayout(image, VK_IMAGE_ASPECT_COLOR_BIT,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          ACQUIRE_WAIT_STAGE, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  barriers.flush(cmdBuffer, &sync);
+
+  float shade = (float)(contentVersion % 8) / 7.0f;
+  clearJob.image = image;
+  clearJob.color = {{shade, 0.25f, 1.0f - shade, 1.0f}};
+  recordClear(cmdBuffer, &clearJob);
+
+  barriers.addImageLayout(image, VK_IMAGE_ASPECT_COLOR_BIT,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  barriers.flush(cmdBuffer, &sync);
+
+  result = vkd.EndCommandBuffer(cmdBuffer);
   assert(result == VK_SUCCESS);
+
+  drawBufferVersions[imageIndex] = contentVersion;
+}
+
+void VulkanExample::releaseDrawBuffers(uint64_t completedFrames) {
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < retiredDrawBuffers.size(); i++) {
+    if (retiredDrawBuffers[i].retireFrame <= completedFrames)
+      vkd.FreeCommandBuffers(device, drawPool, 1,
+                             &retiredDrawBuffers[i].cmdBuffer);
+    else
+      retiredDrawBuffers[kept++] = retiredDrawBuffers[i];
+  }
+
+  retiredDrawBuffers.resize(kept);
+}
+
+void VulkanExample::destroyDrawBuffers() {
+  releaseDrawBuffers(UINT64_MAX);
+
+  for (uint32_t i = 0; i < drawBuffers.size(); i++)
+    if (drawBuffers[i] != VK_NULL_HANDLE)
+      vkd.FreeCommandBuffers(device, drawPool, 1, &drawBuffers[i]);
+
+  vkd.DestroyCommandPool(device, drawPool,
+                         hostAllocator.callbacks(HOST_OBJECT_COMMAND_POOL));
+  drawBuffers.clear();
+  drawBufferVersions.clear();
+  imageFences.clear();
+}
+
+void VulkanExample::trackSwapchainImages(VkImageLayout layout) {
+  for (uint32_t i = 0; i < swapchain.imageCount; i++)
+    imageTracker.track(swapchain.buffers[i].image, VK_IMAGE_ASPECT_COLOR_BIT, 1,
+                       1, layout, swapchain.queueIndex);
+}
+
+void VulkanExample::requestResize(uint32_t width, uint32_t height) {
+  resizePending = true;
+  resizeWidth = width;
+  resizeHeight = height;
+  resizeTime = std::chrono::steady_clock::now();
+}
+
+void VulkanExample::recreateSwapchain() {
+  // The submission thread presents to the current swapchain, which must not
+  // race with it being passed as oldSwapchain.
+  submitQueue.waitIdle();
+
+  // Frames still in flight keep rendering into the old swapchain; it is
+  // destroyed by releaseRetired() once they have completed.
+  VkImage oldImages[MAX_SWAPCHAIN_IMAGES];
+  uint32_t oldImageCount = swapchain.imageCount;
+
+  for (uint32_t i = 0; i < oldImageCount; i++)
+    oldImages[i] = swapchain.buffers[i].image;
+
+  resizePending = !swapchain.recreate(resizeWidth, resizeHeight, frameNumber);
+
+  if (resizePending) return;
+
+  for (uint32_t i = 0; i < oldImageCount; i++)
+    imageTracker.forget(oldImages[i]);
+
+  trackSwapchainImages(VK_IMAGE_LAYOUT_UNDEFINED);
+  resetDrawBuffers();
+
+  fprintf(stdout, "Swapchain recreated: %ux%u\n", swapchain.extent.width,
+          swapchain.extent.height);
+}
+
+bool VulkanExample::drawFrame() {
+  FrameData &frame = frames[frameIndex];
+
+  // Only block until the GPU has retired the frame that last used this slot;
+  // the other slots keep the GPU busy while we record.
+  std::chrono::steady_clock::time_point waitStart =
+      std::chrono::steady_clock::now();
+  VkResult result =
+      vkd.WaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+  assert(result == VK_SUCCESS);
+  std::chrono::steady_clock::time_point waitEnd =
+      std::chrono::steady_clock::now();
+
+  // Frames are submitted in order to a single queue, so this slot's fence
+  // also covers every frame submitted before it. A retired swapchain also
+  // has to wait for its last present to leave the submission thread.
+  if (frameNumber + 1 >= framesInFlight) {
+    uint64_t completed = frameNumber + 1 - framesInFlight;
+    uint64_t presented = submitQueue.presentCount();
+    swapchain.releaseRetired(presented < completed ? presented : completed);
+    releaseDrawBuffers(completed);
+  }
+
+  // Resize storms are debounced: the swapchain is only rebuilt once the
+  // window size has stopped changing for RESIZE_DEBOUNCE_MS.
+  if (resizePending &&
+      waitEnd - resizeTime >= std::chrono::milliseconds(RESIZE_DEBOUNCE_MS))
+    recreateSwapchain();
+
+  // A zero timeout turns this into a try-acquire. Either way the loop never
+  // parks inside the driver for long: when no image is ready the frame is
+  // skipped and control returns to the event pump.
+  // The frame waits on the semaphore on the GPU; nothing here needs to know
+  // on the host when the image is free, so no fence.
+  AcquireResult acquired = submitQueue.acquire(
+      frame.imageAvailable, VK_NULL_HANDLE, acquireTimeout);
+
+  switch (acquired.result) {
+    case VK_SUCCESS:
+      break;
+    case VK_SUBOPTIMAL_KHR:
+      if (!resizePending) requestResize(resizeWidth, resizeHeight);
+      break;
+    case VK_NOT_READY:
+    case VK_TIMEOUT:
+      statsSkipped++;
+      return false;
+    case VK_ERROR_OUT_OF_DATE_KHR:
+      recreateSwapchain();
+      return false;
+    default:
+      VulkanTools::exitOnError("Failed to get next image in swapchain");
+  }
+
+  uint32_t imageIndex = acquired.imageIndex;
+
+  // Everything this slot uploaded last time has been consumed.
+  uploadRing.beginFrame(frameIndex);
+  frame.uploadCmdBuffer = VK_NULL_HANDLE;
+  frame.computeCmdBuffer = VK_NULL_HANDLE;
+
+  VkCommandBuffer cmdBuffer;
+
+  if (staticContent) {
+    // A pre-recorded buffer must not be resubmitted while still pending, and
+    // the frame that last used this image may have come from another slot.
+    VkFence imageFence = imageFences[imageIndex];
+
+    if (imageFence != VK_NULL_HANDLE && imageFence != frame.fence) {
+      result = vkd.WaitForFences(device, 1, &imageFence, VK_TRUE, UINT64_MAX);
+      assert(result == VK_SUCCESS);
+    }
+
+    imageFences[imageIndex] = frame.fence;
+
+    if (drawBufferVersions[imageIndex] != contentVersion)
+      recordDrawBuffer(imageIndex);
+
+    cmdBuffer = drawBuffers[imageIndex];
+  } else {
+    // The fence wait above guarantees the GPU is done with this slot's
+    // command buffers.
+    frameCommands.reset(frameIndex);
+    recorder.resetSlot(frameIndex);
+    frame.cmdBuffer = frameCommands.allocate(frameIndex);
+
+    if (uploadStressBytes > 0 && transferQueue != queue)
+      recordTransferUploads(frame);
+
+    if (computeQueue != queue) recordComputeOverlay(frame);
+
+    recordFrame(frame, imageIndex);
+    cmdBuffer = frame.cmdBuffer;
+  }
+
+  uploadRing.endFrame(frameIndex);
+
+  result = vkd.ResetFences(device, 1, &frame.fence);
+  assert(result == VK_SUCCESS);
+
+  SubmitBatch batch;
+  batch.reset();
+  batch.addWait(frame.imageAvailable, ACQUIRE_WAIT_STAGE);
+
+  if (frame.uploadCmdBuffer != VK_NULL_HANDLE) {
+    SubmitBatch uploads;
+    uploads.reset();
+    uploads.addCommandBuffer(frame.uploadCmdBuffer);
+    uploads.addSignal(frame.uploadDone);
+    transferSubmitQueue.submit(uploads, VK_NULL_HANDLE);
+
+    batch.addWait(frame.uploadDone, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+
+  if (frame.computeCmdBuffer != VK_NULL_HANDLE) {
+    SubmitBatch compute;
+    compute.reset();
+    compute.addCommandBuffer(frame.computeCmdBuffer);
+    compute.addSignal(frame.computeDone);
+    computeSubmitQueue.submit(compute, VK_NULL_HANDLE);
+
+    batch.addWait(frame.computeDone, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+
+  batch.addCommandBuffer(cmdBuffer);
+  batch.addSignal(frame.renderFinished);
+
+  submitQueue.submit(batch, frame.fence);
+  submitQueue.present(imageIndex, frame.renderFinished);
+
+  // With the submission thread this is the result of an earlier present,
+  // which only delays the reaction by a frame or so.
+  result = submitQueue.takePresentResult();
+
+  frameIndex = (frameIndex + 1) % framesInFlight;
+  frameNumber++;
+
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    recreateSwapchain();
+  else if (result == VK_SUBOPTIMAL_KHR && !resizePending)
+    requestResize(resizeWidth, resizeHeight);
+
+  updateFrameStats(waitEnd - waitStart);
+  return true;
+}
+
+void VulkanExample::updateFrameStats(
+    std::chrono::steady_clock::duration waitTime) {
+  statsWaitTime += waitTime;
+  statsFrames++;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - statsStart).count();
+
+  if (elapsed < 1.0) return;
+
+  double waitMs =
+      std::chrono::duration<double, std::milli>(statsWaitTime).count();
+  fprintf(stdout,
+          "%.1f fps, CPU wait %.3f ms/frame (%.1f%% of frame time), "
+          "%u skipped, %llu submit calls\n",
+          statsFrames / elapsed, waitMs / statsFrames,
+          100.0 * waitMs / (elapsed * 1000.0), statsSkipped,
+          (unsigned long long)submitQueue.takeSubmitCalls());
+
+  if (uploadStressBytes > 0)
+    fprintf(stdout, "Uploads: %.1f MB/s, %u skipped for lack of ring space\n",
+            uploadRing.takeUploadedBytes() / elapsed / 1e6,
+            uploadRing.takeOverflows());
+
+  fflush(stdout);
+
+  statsStart = now;
+  statsWaitTime = std::chrono::steady_clock::duration::zero();
+  statsFrames = 0;
+  statsSkipped = 0;
+}
+
+void VulkanExample::checkAllocations() {
+  if (!VulkanAllocationCounter::enabled()) return;
+
+  uint64_t total =
+      VulkanAllocationCounter::count() + hostAllocator.heapAllocationCount();
+  uint64_t made = total - lastAllocationCount;
+  lastAllocationCount = total;
+
+  if (frameNumber <= ALLOCATION_WARMUP_FRAMES || made == 0) return;
+
+  steadyAllocations += made;
+
+  // The first few are enough to find the culprit with a breakpoint.
+  if (allocatingFrames++ < 10)
+    fprintf(stderr, "Frame %llu: %llu heap allocations\n",
+            (unsigned long long)frameNumber, (unsigned long long)made);
+}
+
+void VulkanExample::reportAllocations() {
+  if (!VulkanAllocationCounter::enabled()) return;
+
+  uint64_t frames = frameNumber > ALLOCATION_WARMUP_FRAMES
+                        ? frameNumber - ALLOCATION_WARMUP_FRAMES
+                        : 0;
+  fprintf(stdout,
+          "Allocation check: %llu heap allocations in %u of %llu frames "
+          "after warm-up: %s\n",
+          (unsigned long long)steadyAllocations, allocatingFrames,
+          (unsigned long long)frames,
+          steadyAllocations == 0 ? "passed" : "FAILED");
+}
+
+// Everything the render loop leaves behind except the window; the
+// destructor takes care of the device and instance.
+void VulkanExample::shutdown() {
+  reportAllocations();
+  submitQueue.shutdown();
+  computeSubmitQueue.shutdown();
+  transferSubmitQueue.shutdown();
+  vkd.DeviceWaitIdle(device);
+  pipelineCache.destroy();
+  recorder.destroy();
+  computeCommands.destroy();
+  transferCommands.destroy();
+  destroyDrawBuffers();
+  destroyFrames();
+  destroyUploads();
+  memoryAllocator.printStats(stdout);
+  memoryAllocator.destroy();
+  swapchain.destroy();
+}
+
+int VulkanExample::exitCode() const {
+  return VulkanAllocationCounter::enabled() && steadyAllocations > 0 ? 1 : 0;
 }
 
 void VulkanExample::initSwapchain() {
+  waitForVulkan();
+
 #if defined(_WIN32)
   swapchain.createSurface(windowInstance, window);
 #elif defined(__linux__)
   swapchain.createSurface(connection, window);
 #endif
+
+  // The device only has queues for the families found in initDevices().
+  if (swapchain.queueIndex != queueFamilies.graphics)
+    VulkanTools::exitOnError("The graphics queue cannot present to the window");
+
+  vkd.GetDeviceQueue(device, queueFamilies.graphics, 0, &queue);
+  vkd.GetDeviceQueue(device, queueFamilies.compute, 0, &computeQueue);
+  vkd.GetDeviceQueue(device, queueFamilies.transfer, 0, &transferQueue);
+
+  createCommandPool();
+  createCommandBuffer();
+  beginCommandBuffer();
+  swapchain.create(initialCmdBuffer);
+  trackSwapchainImages(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+  uint32_t phase = startupTimer.begin("initial layout transition");
+  submitCommandBuffer();
+  startupTimer.end(phase);
+
+  phase = startupTimer.begin("frame resources");
+  createFrames();
+  resetDrawBuffers();
+  createUploads();
+  startupTimer.end(phase);
+
+  if (staticContent)
+    fprintf(stdout, "Static content: replaying per-image draw buffers\n");
+
+  // From here on only the submit queues touch the VkQueues.
+  phase = startupTimer.begin("submit and record threads");
+  bool submitThread = VulkanTools::getEnvUint("VK_SUBMIT_THREAD", 1) != 0;
+  submitQueue.init(queue, &sync, &swapchain, submitThread);
+
+  // Compute and upload submissions go straight to the driver. The frame
+  // that waits on their semaphores is queued right after them, and the
+  // signal of a binary semaphore has to be submitted before any wait on it.
+  if (computeQueue != queue) {
+    computeSubmitQueue.init(computeQueue, &sync, NULL, false);
+    computeCommands.init(device, queueFamilies.compute, framesInFlight);
+  }
+
+  if (transferQueue != queue) {
+    transferSubmitQueue.init(transferQueue, &sync, NULL, false);
+    transferCommands.init(device, queueFamilies.transfer, framesInFlight);
+  }
+
+  fprintf(stdout, "Submission thread: %s\n",
+          submitQueue.isThreaded() ? "enabled" : "disabled");
+
+  // A frame has a recording job per row of overlay tiles, enough to keep
+  // every core busy up to MAX_RECORD_THREADS.
+  uint32_t cores = std::thread::hardware_concurrency();
+
+  if (cores < 1) cores = 1;
+
+  if (cores > MAX_RECORD_THREADS) cores = MAX_RECORD_THREADS;
+
+  uint32_t recordThreads = VulkanTools::getEnvUint("VK_RECORD_THREADS", cores);
+
+  if (recordThreads > MAX_RECORD_THREADS) recordThreads = MAX_RECORD_THREADS;
+  recorder.init(device, swapchain.queueIndex, framesInFlight, recordThreads,
+                VulkanTools::getEnvUint("VK_PER_BUFFER_RESET", 0) != 0);
+  startupTimer.end(phase);
+  fprintf(stdout, "Recording threads: %u\n", recorder.threadCount());
+
+  reportStartup();
+}
+
+void VulkanExample::reportStartup() {
+  startupTimer.finish();
+  startupTimer.print(stdout);
+
+  // "-" prints the JSON report to stdout, anything else names a file.
+  const char *jsonPath = getenv("VK_STARTUP_JSON");
+
+  if (jsonPath == NULL || *jsonPath == '\0') return;
+
+  if (strcmp(jsonPath, "-") == 0) {
+    startupTimer.printJson(stdout);
+    return;
+  }
+
+  FILE *file = fopen(jsonPath, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Cannot write the startup report to %s\n", jsonPath);
+    return;
+  }
+
+  startupTimer.printJson(file);
+  fclose(file);
 }
 
 #if defined(_WIN32)
@@ -159,12 +1204,16 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam,
     case WM_PAINT:
       ValidateRect(hWnd, NULL);
       break;
+    case WM_KEYDOWN:
+      if (wParam == VK_F9) hostAllocator.requestStats();
+      break;
   }
 
   return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
 void VulkanExample::createWindow(HINSTANCE hInstance) {
+  StartupPhase phase("window");
   WNDCLASSEX wcex;
 
   wcex.cbSize = sizeof(WNDCLASSEX);
@@ -201,31 +1250,55 @@ void VulkanExample::createWindow(HINSTANCE hInstance) {
 }
 
 void VulkanExample::renderLoop() {
+  bool running = true;
   MSG message;
 
-  while (GetMessage(&message, NULL, 0, 0)) {
-    TranslateMessage(&message);
-    DispatchMessage(&message);
+  while (running) {
+    while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE)) {
+      if (message.message == WM_QUIT) running = false;
+
+      TranslateMessage(&message);
+      DispatchMessage(&message);
+    }
+
+    if (hostAllocator.takeStatsRequest()) hostAllocator.printStats(stdout);
+
+    if (frameLimit > 0 && frameNumber >= frameLimit) running = false;
+
+    if (running) drawFrame();
+
+    checkAllocations();
   }
+
+  shutdown();
 }
 
 #elif defined(__linux__)
 void VulkanExample::createWindow() {
+  uint32_t phase = startupTimer.begin("XCB connect");
   int screenp = 0;
   connection = xcb_connect(NULL, &screenp);
 
   if (xcb_connection_has_error(connection))
     VulkanTools::exitOnError("Failed to connect to X server using XCB.");
 
+  keySymbols = xcb_key_symbols_alloc(connection);
+  startupTimer.end(phase);
+
   xcb_screen_iterator_t iter =
       xcb_setup_roots_iterator(xcb_get_setup(connection));
 
   for (int s = screenp; s > 0; s--) xcb_screen_next(&iter);
 
   screen = iter.data;
+
+  phase = startupTimer.begin("XCB window");
   window = xcb_generate_id(connection);
   uint32_t eventMask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
-  uint32_t valueList[] = {screen->black_pixel, 0};
+  uint32_t valueList[] = {screen->black_pixel,
+                          XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+                              XCB_EVENT_MASK_POINTER_MOTION |
+                              XCB_EVENT_MASK_KEY_PRESS};
 
   xcb_create_window(connection, XCB_COPY_FROM_PARENT, window, screen->root, 0,
                     0, WINDOW_WIDTH, WINDOW_HEIGHT, 0,
@@ -234,7 +1307,10 @@ void VulkanExample::createWindow() {
   xcb_change_property(connection, XCB_PROP_MODE_REPLACE, window,
                       XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8,
                       strlen(APPLICATION_NAME), APPLICATION_NAME);
+  startupTimer.end(phase);
 
+  // Waits for the X server to answer both requests.
+  phase = startupTimer.begin("XCB atoms");
   xcb_intern_atom_cookie_t wmDeleteCookie = xcb_intern_atom(
       connection, 0, strlen("WM_DELETE_WINDOW"), "WM_DELETE_WINDOW");
   xcb_intern_atom_cookie_t wmProtocolsCookie =
@@ -250,29 +1326,48 @@ void VulkanExample::createWindow() {
                       wmProtocolsReply->atom, 4, 32, 1, &wmDeleteReply->atom);
   xcb_map_window(connection, window);
   xcb_flush(connection);
+  startupTimer.end(phase);
 }
 
 void VulkanExample::renderLoop() {
-  bool running = true;
-  xcb_generic_event_t *event;
-  xcb_client_message_event_t *cm;
+  bool threadedInput = VulkanTools::getEnvUint("VK_INPUT_THREAD", 0) != 0;
+  eventPump.init(connection, wmDeleteWin, WINDOW_WIDTH, WINDOW_HEIGHT,
+                 threadedInput);
 
-  while (running) {
-    event = xcb_wait_for_event(connection);
+  memset(&windowEvents, 0, sizeof(windowEvents));
+  windowEvents.width = WINDOW_WIDTH;
+  windowEvents.height = WINDOW_HEIGHT;
 
-    switch (event->response_type & ~0x80) {
-      case XCB_CLIENT_MESSAGE: {
-        cm = (xcb_client_message_event_t *)event;
+  while (true) {
+    eventPump.pump(windowEvents);
 
-        if (cm->data.data32[0] == wmDeleteWin) running = false;
+    if (windowEvents.quit) break;
 
-        break;
-      }
+    if (windowEvents.resized)
+      requestResize(windowEvents.width, windowEvents.height);
+
+    // Space changes the content, which static content mode re-records for.
+    // F9 prints the driver's host memory use.
+    for (uint32_t i = 0; i < windowEvents.keyCount; i++) {
+      xcb_keysym_t keysym =
+          xcb_key_symbols_get_keysym(keySymbols, windowEvents.keys[i], 0);
+
+      if (keysym == XK_space) markContentDirty();
+
+      if (keysym == XK_F9) hostAllocator.requestStats();
     }
 
-    free(event);
+    if (hostAllocator.takeStatsRequest()) hostAllocator.printStats(stdout);
+
+    if (frameLimit > 0 && frameNumber >= frameLimit) break;
+
+    drawFrame();
+    checkAllocations();
   }
 
+  eventPump.shutdown();
+  shutdown();
   xcb_destroy_window(connection, window);
+  xcb_key_symbols_free(keySymbols);
 }
 #endif
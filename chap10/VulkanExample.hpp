@@ -5,33 +5,183 @@
 #include <stdlib.h>
 #include <vulkan/vulkan.h>
 #include <cassert>
+#include <chrono>
 #include <cstring>
+#include <thread>
 #include <vector>
 #if defined(_WIN32)
 #include <Windows.h>
 #elif defined(__linux__)
+#include <X11/keysym.h>
 #include <xcb/xcb.h>
+#include <xcb/xcb_keysyms.h>
 #endif
 
+#include "VulkanAllocationCounter.hpp"
+#include "VulkanBarrierBatch.hpp"
+#include "VulkanCommandAllocator.hpp"
+#include "VulkanCommandRecorder.hpp"
+#include "VulkanDeviceSelector.hpp"
+#include "VulkanDeviceTable.hpp"
+#include "VulkanEventPump.hpp"
+#include "VulkanHostAllocator.hpp"
+#include "VulkanImageTracker.hpp"
+#include "VulkanMemoryAllocator.hpp"
+#include "VulkanPipelineCache.hpp"
+#include "VulkanStartupTimer.hpp"
+#include "VulkanSubmitQueue.hpp"
 #include "VulkanSwapchain.hpp"
+#include "VulkanSync.hpp"
 #include "VulkanTools.hpp"
+#include "VulkanUploadRing.hpp"
+
+struct FrameData {
+  VkCommandBuffer cmdBuffer;
+  VkFence fence;
+  VkSemaphore imageAvailable;
+  VkSemaphore renderFinished;
+  // Set when this frame's uploads run on the transfer queue, which signals
+  // uploadDone for the frame to wait on.
+  VkCommandBuffer uploadCmdBuffer;
+  VkSemaphore uploadDone;
+  // Cleared on the compute queue when it has a family of its own, which
+  // then signals computeDone; otherwise cleared at the start of the frame.
+  VkImage overlay;
+  MemoryAllocation overlayMemory;
+  VkCommandBuffer computeCmdBuffer;
+  VkSemaphore computeDone;
+};
+
+struct RetiredCommandBuffer {
+  VkCommandBuffer cmdBuffer;
+  uint64_t retireFrame;
+};
+
+struct ClearJob {
+  VkImage image;
+  VkClearColorValue color;
+};
+
+// One row of overlay tiles, starting at `firstX` and then every other tile.
+struct TileJob {
+  VkImage overlay;
+  VkImage image;
+  VkExtent2D extent;
+  uint32_t y;
+  uint32_t firstX;
+};
 
 class VulkanExample {
  private:
+  void initVulkan();
+  void waitForVulkan();
   void createInstance();
   void initDevices();
   void createCommandPool();
   void createCommandBuffer();
   void beginCommandBuffer();
+  void submitCommandBuffer();
+  void createFrames();
+  void destroyFrames();
+  void recordFrame(FrameData &frame, uint32_t imageIndex);
+  void createUploads();
+  bool recordUploadStress(VkCommandBuffer cmdBuffer);
+  void recordTransferUploads(FrameData &frame);
+  void destroyUploads();
+  void recordOverlay(VkCommandBuffer cmdBuffer, FrameData &frame);
+  void recordComputeOverlay(FrameData &frame);
+  void resetDrawBuffers();
+  void recordDrawBuffer(uint32_t imageIndex);
+  void releaseDrawBuffers(uint64_t completedFrames);
+  void destroyDrawBuffers();
+  void trackSwapchainImages(VkImageLayout layout);
+  void requestResize(uint32_t width, uint32_t height);
+  void recreateSwapchain();
+  bool drawFrame();
+  void updateFrameStats(std::chrono::steady_clock::duration waitTime);
+  void checkAllocations();
+  void reportAllocations();
+  void shutdown();
+  void reportStartup();
+
+  // Runs initVulkan() while the window is being created.
+  std::thread initThread;
 
   VkInstance instance;
   VkPhysicalDevice physicalDevice;
   VkDevice device;
+  VkQueue queue;
+  VulkanSync sync;
+  VulkanPipelineCache pipelineCache;
+  VulkanMemoryAllocator memoryAllocator;
   VulkanSwapchain swapchain;
+  VulkanSubmitQueue submitQueue;
+
+  // The compute and transfer queues run the frame's overlay and uploads
+  // when they have a family of their own; otherwise they are the graphics
+  // queue and the work is recorded into the frame.
+  VulkanTools::QueueFamilies queueFamilies;
+  VkQueue computeQueue;
+  VulkanSubmitQueue computeSubmitQueue;
+  VulkanCommandAllocator computeCommands;
+  VkQueue transferQueue;
+  VulkanSubmitQueue transferSubmitQueue;
+  VulkanCommandAllocator transferCommands;
   VkCommandPool cmdPool;
+  VkCommandPool drawPool;
   VkCommandBuffer initialCmdBuffer;
+  VulkanCommandAllocator frameCommands;
 
+  // Static content mode: one pre-recorded command buffer per swapchain
+  // image, replayed until contentVersion moves past the version it was
+  // recorded at.
+  bool staticContent;
+  uint64_t contentVersion;
   std::vector<VkCommandBuffer> drawBuffers;
+  std::vector<uint64_t> drawBufferVersions;
+  std::vector<VkFence> imageFences;
+  std::vector<RetiredCommandBuffer> retiredDrawBuffers;
+
+  VulkanCommandRecorder recorder;
+  ClearJob clearJob;
+  // Only ever grown, so steady-state frames do not allocate.
+  std::vector<TileJob> tileJobs;
+  std::vector<RecordJob> tileRecordJobs;
+
+  // Staging for per-frame data. With VK_UPLOAD_STRESS_MB set, every frame
+  // streams that much through the ring into its own region of uploadTarget.
+  VulkanUploadRing uploadRing;
+  VkDeviceSize uploadStressBytes;
+  VkBuffer uploadTarget;
+  MemoryAllocation uploadTargetMemory;
+
+  VulkanImageTracker imageTracker;
+  VulkanBarrierBatch barriers;
+
+  std::vector<FrameData> frames;
+  uint32_t framesInFlight;
+  uint32_t frameIndex;
+  uint64_t frameNumber;
+  uint64_t acquireTimeout;
+
+  bool resizePending;
+  uint32_t resizeWidth;
+  uint32_t resizeHeight;
+  std::chrono::steady_clock::time_point resizeTime;
+
+  // VK_FRAME_LIMIT ends the render loop after that many frames. With
+  // VK_ALLOCATION_CHECK set, every operator new and host allocator heap
+  // fallback after the warm-up frames is reported and makes the exit status
+  // nonzero.
+  uint64_t frameLimit;
+  uint64_t lastAllocationCount;
+  uint64_t steadyAllocations;
+  uint32_t allocatingFrames;
+
+  std::chrono::steady_clock::time_point statsStart;
+  std::chrono::steady_clock::duration statsWaitTime;
+  uint32_t statsFrames;
+  uint32_t statsSkipped;
 #if defined(_WIN32)
   HINSTANCE windowInstance;
   HWND window;
@@ -41,6 +191,9 @@ class VulkanExample {
   xcb_screen_t *screen;
   xcb_atom_t wmProtocols;
   xcb_atom_t wmDeleteWin;
+  xcb_key_symbols_t *keySymbols;
+  VulkanEventPump eventPump;
+  WindowEvents windowEvents;
 #endif
  public:
   VulkanExample();
@@ -52,7 +205,9 @@ class VulkanExample {
   void createWindow();
 #endif
   void initSwapchain();
+  void markContentDirty() { contentVersion++; }
   void renderLoop();
+  int exitCode() const;
 };
 
 #endif  // VULKAN_EXAMPLE_HPP
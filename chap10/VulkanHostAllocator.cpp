@@ -0,0 +1,466 @@
+#include "VulkanHostAllocator.hpp"
+
+#include <stdlib.h>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#define HOST_HEADER_SIZE 16
+#define HOST_POOL_MAX_SIZE \
+  (1 << (HOST_POOL_MIN_SHIFT + HOST_POOL_CLASSES - 1))
+#define HOST_SOURCE_ARENA 0xfe
+#define HOST_SOURCE_HEAP 0xff
+
+VulkanHostAllocator hostAllocator;
+
+// Sits just before every pointer handed to the driver.
+struct HostHeader {
+  uint64_t size;
+  uint32_t alignment;
+  // A size class, HOST_SOURCE_ARENA or HOST_SOURCE_HEAP.
+  uint8_t source;
+  uint8_t scope;
+  uint16_t objectType;
+};
+
+static_assert(sizeof(HostHeader) == HOST_HEADER_SIZE,
+              "allocations must stay 16-byte aligned");
+
+// Arenas are aligned to their size, so the arena an allocation came from
+// is found by masking its address. Allocations start after this struct.
+struct HostArena {
+  std::atomic<uint32_t> live;
+  size_t top;
+};
+
+#define HOST_ARENA_START \
+  ((sizeof(HostArena) + HOST_HEADER_SIZE - 1) & ~(HOST_HEADER_SIZE - 1))
+
+struct VulkanHostAllocator::ThreadCache {
+  VulkanHostAllocator *owner;
+  void *heads[HOST_POOL_CLASSES];
+  uint32_t counts[HOST_POOL_CLASSES];
+  HostArena *arena;
+
+  ThreadCache() : owner(NULL), arena(NULL) {
+    for (uint32_t i = 0; i < HOST_POOL_CLASSES; i++) {
+      heads[i] = NULL;
+      counts[i] = 0;
+    }
+  }
+
+  // Hands everything back, since threads come and go in the driver too.
+  ~ThreadCache() {
+    if (owner != NULL) owner->releaseThread(*this);
+  }
+};
+
+static void *alignedAlloc(size_t alignment, size_t size) {
+#if defined(_WIN32)
+  return _aligned_malloc(size, alignment);
+#else
+  void *memory = NULL;
+
+  if (posix_memalign(&memory, alignment, size) != 0) return NULL;
+
+  return memory;
+#endif
+}
+
+static void alignedFree(void *memory) {
+#if defined(_WIN32)
+  _aligned_free(memory);
+#else
+  ::free(memory);
+#endif
+}
+
+static const char *scopeNames[HOST_SCOPE_COUNT] = {
+    "command", "object", "cache", "device", "instance"};
+
+static const char *objectNames[HOST_OBJECT_COUNT] = {
+    "other",         "instance",       "device",     "surface",
+    "swapchain",     "image",          "image view", "framebuffer",
+    "command pool",  "fence",          "semaphore",  "buffer",
+    "device memory", "pipeline cache"};
+
+void HostAllocationCounter::add(uint64_t size) {
+  uint64_t now = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+
+  while (now > peak &&
+         !peakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+    ;
+
+  count.fetch_add(1, std::memory_order_relaxed);
+  calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HostAllocationCounter::remove(uint64_t size) {
+  bytes.fetch_sub(size, std::memory_order_relaxed);
+  count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+static HostHeader *headerOf(void *memory) {
+  return (HostHeader *)((uint8_t *)memory - HOST_HEADER_SIZE);
+}
+
+static uint32_t sizeClassFor(size_t size) {
+  uint32_t sizeClass = 0;
+
+  while (((size_t)1 << (HOST_POOL_MIN_SHIFT + sizeClass)) < size) sizeClass++;
+
+  return sizeClass;
+}
+
+VulkanHostAllocator::VulkanHostAllocator()
+    : enabled(false), statsRequested(false), heapAllocations(0) {
+  for (uint32_t i = 0; i < HOST_OBJECT_COUNT; i++) {
+    tags[i].allocator = this;
+    tags[i].objectType = i;
+
+    allocationCallbacks[i].pUserData = &tags[i];
+    allocationCallbacks[i].pfnAllocation = allocationCallback;
+    allocationCallbacks[i].pfnReallocation = reallocationCallback;
+    allocationCallbacks[i].pfnFree = freeCallback;
+    allocationCallbacks[i].pfnInternalAllocation = internalAllocationCallback;
+    allocationCallbacks[i].pfnInternalFree = internalFreeCallback;
+  }
+
+  for (uint32_t i = 0; i < HOST_POOL_CLASSES; i++) classes[i].head = NULL;
+}
+
+VulkanHostAllocator::~VulkanHostAllocator() {
+  for (size_t i = 0; i < blocks.size(); i++) alignedFree(blocks[i]);
+}
+
+void VulkanHostAllocator::init(bool enabled) { this->enabled = enabled; }
+
+VulkanHostAllocator::ThreadCache &VulkanHostAllocator::threadCache() {
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+void *VulkanHostAllocator::newBlock(size_t size, size_t alignment) {
+  void *block = alignedAlloc(alignment, size);
+
+  if (block == NULL) return NULL;
+
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(blockMutex);
+  blocks.push_back(block);
+  return block;
+}
+
+void VulkanHostAllocator::refill(uint32_t sizeClass, ThreadCache &cache) {
+  SizeClass &shared = classes[sizeClass];
+  std::lock_guard<std::mutex> lock(shared.mutex);
+
+  if (shared.head == NULL) {
+    uint8_t *slab =
+        (uint8_t *)newBlock(HOST_POOL_SLAB_SIZE, HOST_HEADER_SIZE);
+
+    if (slab == NULL) return;
+
+    size_t chunkSize = (size_t)1 << (HOST_POOL_MIN_SHIFT + sizeClass);
+
+    for (size_t offset = 0; offset < HOST_POOL_SLAB_SIZE;
+         offset += chunkSize) {
+      *(void **)(slab + offset) = shared.head;
+      shared.head = slab + offset;
+    }
+  }
+
+  while (shared.head != NULL && cache.counts[sizeClass] < HOST_POOL_BATCH) {
+    void *chunk = shared.head;
+    shared.head = *(void **)chunk;
+    *(void **)chunk = cache.heads[sizeClass];
+    cache.heads[sizeClass] = chunk;
+    cache.counts[sizeClass]++;
+  }
+}
+
+void *VulkanHostAllocator::allocatePooled(uint32_t sizeClass) {
+  ThreadCache &cache = threadCache();
+
+  if (cache.owner == NULL) cache.owner = this;
+
+  assert(cache.owner == this);
+
+  if (cache.heads[sizeClass] == NULL) refill(sizeClass, cache);
+
+  void *chunk = cache.heads[sizeClass];
+
+  if (chunk == NULL) return NULL;
+
+  cache.heads[sizeClass] = *(void **)chunk;
+  cache.counts[sizeClass]--;
+  return chunk;
+}
+
+void VulkanHostAllocator::freePooled(uint32_t sizeClass, void *chunk) {
+  ThreadCache &cache = threadCache();
+
+  if (cache.owner == NULL) cache.owner = this;
+
+  *(void **)chunk = cache.heads[sizeClass];
+  cache.heads[sizeClass] = chunk;
+
+  if (++cache.counts[sizeClass] < 2 * HOST_POOL_BATCH) return;
+
+  SizeClass &shared = classes[sizeClass];
+  std::lock_guard<std::mutex> lock(shared.mutex);
+
+  for (uint32_t i = 0; i < HOST_POOL_BATCH; i++) {
+    chunk = cache.heads[sizeClass];
+    cache.heads[sizeClass] = *(void **)chunk;
+    *(void **)chunk = shared.head;
+    shared.head = chunk;
+  }
+
+  cache.counts[sizeClass] -= HOST_POOL_BATCH;
+}
+
+void *VulkanHostAllocator::allocateArena(size_t size, size_t alignment) {
+  ThreadCache &cache = threadCache();
+
+  if (cache.owner == NULL) cache.owner = this;
+
+  assert(cache.owner == this);
+
+  HostArena *arena = cache.arena;
+
+  if (arena == NULL) {
+    {
+      std::lock_guard<std::mutex> lock(blockMutex);
+
+      if (!spareArenas.empty()) {
+        arena = (HostArena *)spareArenas.back();
+        spareArenas.pop_back();
+      }
+    }
+
+    if (arena == NULL) {
+      void *block = newBlock(HOST_ARENA_SIZE, HOST_ARENA_SIZE);
+
+      if (block == NULL) return NULL;
+
+      arena = new (block) HostArena();
+      arena->live.store(0);
+      arena->top = HOST_ARENA_START;
+    }
+
+    cache.arena = arena;
+  }
+
+  // Only this thread moves `top`, and only when nothing in the arena is
+  // still in use.
+  if (arena->live.load(std::memory_order_acquire) == 0)
+    arena->top = HOST_ARENA_START;
+
+  size_t offset =
+      (arena->top + HOST_HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+
+  if (offset + size > HOST_ARENA_SIZE) return NULL;
+
+  arena->top = offset + size;
+  arena->live.fetch_add(1, std::memory_order_relaxed);
+  return (uint8_t *)arena + offset;
+}
+
+void VulkanHostAllocator::releaseThread(ThreadCache &cache) {
+  for (uint32_t i = 0; i < HOST_POOL_CLASSES; i++) {
+    if (cache.heads[i] == NULL) continue;
+
+    void *tail = cache.heads[i];
+
+    while (*(void **)tail != NULL) tail = *(void **)tail;
+
+    std::lock_guard<std::mutex> lock(classes[i].mutex);
+    *(void **)tail = classes[i].head;
+    classes[i].head = cache.heads[i];
+    cache.heads[i] = NULL;
+    cache.counts[i] = 0;
+  }
+
+  if (cache.arena != NULL) {
+    std::lock_guard<std::mutex> lock(blockMutex);
+    spareArenas.push_back(cache.arena);
+    cache.arena = NULL;
+  }
+}
+
+void *VulkanHostAllocator::allocate(size_t size, size_t alignment,
+                                    VkSystemAllocationScope scope,
+                                    uint32_t objectType) {
+  if (alignment < HOST_HEADER_SIZE) alignment = HOST_HEADER_SIZE;
+
+  uint8_t *memory = NULL;
+  uint8_t source = HOST_SOURCE_HEAP;
+
+  if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+    memory = (uint8_t *)allocateArena(size, alignment);
+    source = HOST_SOURCE_ARENA;
+  }
+
+  if (memory == NULL && alignment == HOST_HEADER_SIZE &&
+      size <= HOST_POOL_MAX_SIZE - HOST_HEADER_SIZE) {
+    source = (uint8_t)sizeClassFor(size + HOST_HEADER_SIZE);
+    memory = (uint8_t *)allocatePooled(source);
+
+    if (memory != NULL) memory += HOST_HEADER_SIZE;
+  }
+
+  if (memory == NULL) {
+    memory = (uint8_t *)alignedAlloc(alignment, alignment + size);
+
+    if (memory == NULL) return NULL;
+
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    memory += alignment;
+    source = HOST_SOURCE_HEAP;
+  }
+
+  HostHeader *header = headerOf(memory);
+  header->size = size;
+  header->alignment = (uint32_t)alignment;
+  header->source = source;
+  header->scope = (uint8_t)scope;
+  header->objectType = (uint16_t)objectType;
+
+  scopeCounters[scope].add(size);
+  objectCounters[objectType].add(size);
+  return memory;
+}
+
+void *VulkanHostAllocator::reallocate(void *original, size_t size,
+                                      size_t alignment,
+                                      VkSystemAllocationScope scope,
+                                      uint32_t objectType) {
+  if (original == NULL) return allocate(size, alignment, scope, objectType);
+
+  if (size == 0) {
+    free(original);
+    return NULL;
+  }
+
+  HostHeader *header = headerOf(original);
+
+  if (header->source < HOST_POOL_CLASSES &&
+      size + HOST_HEADER_SIZE <=
+          ((size_t)1 << (HOST_POOL_MIN_SHIFT + header->source))) {
+    scopeCounters[header->scope].remove(header->size);
+    objectCounters[header->objectType].remove(header->size);
+    scopeCounters[header->scope].add(size);
+    objectCounters[header->objectType].add(size);
+    header->size = size;
+    return original;
+  }
+
+  // The copy is charged to whoever made the original.
+  void *memory =
+      allocate(size, alignment, (VkSystemAllocationScope)header->scope,
+               header->objectType);
+
+  // The original must survive a failed reallocation.
+  if (memory == NULL) return NULL;
+
+  memcpy(memory, original, size < header->size ? size : header->size);
+  free(original);
+  return memory;
+}
+
+void VulkanHostAllocator::free(void *memory) {
+  if (memory == NULL) return;
+
+  HostHeader *header = headerOf(memory);
+  scopeCounters[header->scope].remove(header->size);
+  objectCounters[header->objectType].remove(header->size);
+
+  if (header->source == HOST_SOURCE_ARENA) {
+    uintptr_t base = (uintptr_t)memory & ~(uintptr_t)(HOST_ARENA_SIZE - 1);
+    ((HostArena *)base)->live.fetch_sub(1, std::memory_order_release);
+  } else if (header->source == HOST_SOURCE_HEAP) {
+    alignedFree((uint8_t *)memory - header->alignment);
+  } else {
+    freePooled(header->source, (uint8_t *)memory - HOST_HEADER_SIZE);
+  }
+}
+
+static void printCounter(FILE *file, const char *name,
+                         const HostAllocationCounter &counter) {
+  uint64_t calls = counter.calls.load(std::memory_order_relaxed);
+
+  if (calls == 0) return;
+
+  fprintf(file, "  %-15s %10.1f KiB, peak %10.1f KiB, %llu of %llu live\n",
+          name, counter.bytes.load(std::memory_order_relaxed) / 1024.0,
+          counter.peakBytes.load(std::memory_order_relaxed) / 1024.0,
+          (unsigned long long)counter.count.load(std::memory_order_relaxed),
+          (unsigned long long)calls);
+}
+
+void VulkanHostAllocator::printStats(FILE *file) {
+  if (!enabled) return;
+
+  fprintf(file, "Driver host memory by allocation scope:\n");
+
+  for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++)
+    printCounter(file, scopeNames[i], scopeCounters[i]);
+
+  fprintf(file, "Driver host memory by object type:\n");
+
+  for (uint32_t i = 0; i < HOST_OBJECT_COUNT; i++)
+    printCounter(file, objectNames[i], objectCounters[i]);
+
+  bool internal = false;
+
+  for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++)
+    internal = internal || internalCounters[i].calls.load() != 0;
+
+  if (internal) {
+    fprintf(file, "Driver-internal host memory by allocation scope:\n");
+
+    for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++)
+      printCounter(file, scopeNames[i], internalCounters[i]);
+  }
+
+  fflush(file);
+}
+
+VKAPI_ATTR void *VKAPI_CALL VulkanHostAllocator::allocationCallback(
+    void *userData, size_t size, size_t alignment,
+    VkSystemAllocationScope scope) {
+  CallbackTag *tag = (CallbackTag *)userData;
+  return tag->allocator->allocate(size, alignment, scope, tag->objectType);
+}
+
+VKAPI_ATTR void *VKAPI_CALL VulkanHostAllocator::reallocationCallback(
+    void *userData, void *original, size_t size, size_t alignment,
+    VkSystemAllocationScope scope) {
+  CallbackTag *tag = (CallbackTag *)userData;
+  return tag->allocator->reallocate(original, size, alignment, scope,
+                                    tag->objectType);
+}
+
+VKAPI_ATTR void VKAPI_CALL VulkanHostAllocator::freeCallback(void *userData,
+                                                             void *memory) {
+  ((CallbackTag *)userData)->allocator->free(memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL VulkanHostAllocator::internalAllocationCallback(
+    void *userData, size_t size, VkInternalAllocationType type,
+    VkSystemAllocationScope scope) {
+  (void)type;
+  ((CallbackTag *)userData)->allocator->internalCounters[scope].add(size);
+}
+
+VKAPI_ATTR void VKAPI_CALL VulkanHostAllocator::internalFreeCallback(
+    void *userData, size_t size, VkInternalAllocationType type,
+    VkSystemAllocationScope scope) {
+  (void)type;
+  ((CallbackTag *)userData)->allocator->internalCounters[scope].remove(size);
+}
@@ -0,0 +1,153 @@
+#ifndef VULKAN_HOST_ALLOCATOR_HPP
+#define VULKAN_HOST_ALLOCATOR_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Size classes are powers of two from 16 bytes to 4 KiB.
+#define HOST_POOL_MIN_SHIFT 4
+#define HOST_POOL_CLASSES 9
+#define HOST_POOL_SLAB_SIZE (64 << 10)
+// Chunks moved between a thread's cache and the shared lists at a time.
+#define HOST_POOL_BATCH 32
+#define HOST_ARENA_SIZE (64 << 10)
+#define HOST_SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+// What the allocations made through a set of callbacks are charged to. The
+// driver is free to allocate for an object's children through its parent's
+// callbacks, so these are approximate below the device.
+enum HostObjectType {
+  HOST_OBJECT_OTHER,
+  HOST_OBJECT_INSTANCE,
+  HOST_OBJECT_DEVICE,
+  HOST_OBJECT_SURFACE,
+  HOST_OBJECT_SWAPCHAIN,
+  HOST_OBJECT_IMAGE,
+  HOST_OBJECT_IMAGE_VIEW,
+  HOST_OBJECT_FRAMEBUFFER,
+  HOST_OBJECT_COMMAND_POOL,
+  HOST_OBJECT_FENCE,
+  HOST_OBJECT_SEMAPHORE,
+  HOST_OBJECT_BUFFER,
+  HOST_OBJECT_DEVICE_MEMORY,
+  HOST_OBJECT_PIPELINE_CACHE,
+  HOST_OBJECT_COUNT
+};
+
+// Live and peak bytes of one category, updated without locks.
+struct HostAllocationCounter {
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> peakBytes;
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> calls;
+
+  HostAllocationCounter() : bytes(0), peakBytes(0), count(0), calls(0) {}
+
+  void add(uint64_t size);
+  void remove(uint64_t size);
+};
+
+// Host memory for the driver, passed as pAllocator to every create and
+// destroy call. Allocations the driver only needs while one command runs
+// (VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) are bump-allocated from a per-thread
+// arena, which is rewound in one step once all of them have been freed.
+// Everything else up to 4 KiB comes from size classes carved out of
+// HOST_POOL_SLAB_SIZE slabs; each thread keeps a free list per class and
+// trades whole batches with the shared lists, so recording threads rarely
+// take a lock. Larger or over-aligned requests go to the system heap.
+//
+// Slabs and arenas are only returned to the system by the destructor,
+// which runs after main() when the driver is long done with them.
+//
+// Every allocation is also counted by scope and by the object type whose
+// callbacks it came through, along with the driver's notifications about
+// memory it allocated itself (such as executable code). printStats() can be
+// called at any time; requestStats() is safe from a signal handler.
+class VulkanHostAllocator {
+ private:
+  struct SizeClass {
+    std::mutex mutex;
+    void *head;
+  };
+
+  struct ThreadCache;
+
+  struct CallbackTag {
+    VulkanHostAllocator *allocator;
+    uint32_t objectType;
+  };
+
+  VkAllocationCallbacks allocationCallbacks[HOST_OBJECT_COUNT];
+  CallbackTag tags[HOST_OBJECT_COUNT];
+  bool enabled;
+  SizeClass classes[HOST_POOL_CLASSES];
+  std::mutex blockMutex;
+  std::vector<void *> blocks;
+  // Arenas left behind by threads that have exited.
+  std::vector<void *> spareArenas;
+
+  HostAllocationCounter scopeCounters[HOST_SCOPE_COUNT];
+  HostAllocationCounter objectCounters[HOST_OBJECT_COUNT];
+  HostAllocationCounter internalCounters[HOST_SCOPE_COUNT];
+  std::atomic<bool> statsRequested;
+  std::atomic<uint64_t> heapAllocations;
+
+  static ThreadCache &threadCache();
+
+  void *newBlock(size_t size, size_t alignment);
+  void refill(uint32_t sizeClass, ThreadCache &cache);
+  void *allocatePooled(uint32_t sizeClass);
+  void freePooled(uint32_t sizeClass, void *chunk);
+  void *allocateArena(size_t size, size_t alignment);
+  void releaseThread(ThreadCache &cache);
+
+  void *allocate(size_t size, size_t alignment,
+                 VkSystemAllocationScope scope, uint32_t objectType);
+  void *reallocate(void *original, size_t size, size_t alignment,
+                   VkSystemAllocationScope scope, uint32_t objectType);
+  void free(void *memory);
+
+  static VKAPI_ATTR void *VKAPI_CALL allocationCallback(
+      void *userData, size_t size, size_t alignment,
+      VkSystemAllocationScope scope);
+  static VKAPI_ATTR void *VKAPI_CALL reallocationCallback(
+      void *userData, void *original, size_t size, size_t alignment,
+      VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL freeCallback(void *userData,
+                                                 void *memory);
+  static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(
+      void *userData, size_t size, VkInternalAllocationType type,
+      VkSystemAllocationScope scope);
+  static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(
+      void *userData, size_t size, VkInternalAllocationType type,
+      VkSystemAllocationScope scope);
+
+ public:
+  VulkanHostAllocator();
+  ~VulkanHostAllocator();
+
+  // Must be called before the instance is created and not changed after.
+  void init(bool enabled);
+
+  // What to pass as pAllocator when creating or destroying an object of
+  // `type`; NULL when the driver should use its own allocator.
+  const VkAllocationCallbacks *callbacks(HostObjectType type) const {
+    return enabled ? &allocationCallbacks[type] : NULL;
+  }
+
+  void requestStats() { statsRequested.store(true); }
+  bool takeStatsRequest() { return statsRequested.exchange(false); }
+
+  void printStats(FILE *file);
+
+  // Slabs, arenas and oversized blocks taken from the system heap so far.
+  uint64_t heapAllocationCount() const { return heapAllocations.load(); }
+};
+
+extern VulkanHostAllocator hostAllocator;
+
+#endif  // VULKAN_HOST_ALLOCATOR_HPP
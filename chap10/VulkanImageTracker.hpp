@@ -0,0 +1,351 @@
+#ifndef VULKAN_IMAGE_TRACKER_HPP
+#define VULKAN_IMAGE_TRACKER_HPP
+
+#include <vulkan/vulkan.h>
+#include <cassert>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanBarrierBatch.hpp"
+#include "VulkanTools.hpp"
+
+#define WRITE_ACCESS_MASK                                                  \
+  (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |     \
+   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |                          \
+   VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |               \
+   VK_ACCESS_MEMORY_WRITE_BIT)
+
+// What the GPU last did to one mip level of one array layer.
+struct SubresourceState {
+  VkImageLayout layout;
+  // The family that owns the subresource, or VK_QUEUE_FAMILY_IGNORED when
+  // only one family ever uses it.
+  uint32_t queueFamily;
+  // The last write, which later accesses have to wait for.
+  VkPipelineStageFlags writeStages;
+  VkAccessFlags writeAccess;
+  // Reads since that write, which a later write has to wait for.
+  VkPipelineStageFlags readStages;
+  // Stages and accesses the last write has already been made visible to.
+  VkPipelineStageFlags visibleStages;
+  VkAccessFlags visibleAccess;
+
+  bool operator==(const SubresourceState &other) const {
+    return layout == other.layout && queueFamily == other.queueFamily &&
+           writeStages == other.writeStages &&
+           writeAccess == other.writeAccess &&
+           readStages == other.readStages &&
+           visibleStages == other.visibleStages &&
+           visibleAccess == other.visibleAccess;
+  }
+};
+
+// Tracks the layout and pending accesses of every subresource of the images
+// it is told about, in command recording order. Callers only say how they
+// are about to use an image; the tracker works out whether a barrier is
+// needed at all and, if so, the narrowest one, and queues it on a
+// VulkanBarrierBatch so that several transitions share one
+// vkCmdPipelineBarrier. Images used by more than one queue family change
+// owner through release() and acquire().
+class VulkanImageTracker {
+ private:
+  struct TrackedImage {
+    VkImageAspectFlags aspects;
+    uint32_t levels;
+    uint32_t layers;
+    std::vector<SubresourceState> states;
+    // Set between the two halves of a queue family ownership transfer, whose
+    // barriers have to agree on the layouts.
+    bool transferPending;
+    uint32_t transferSrcFamily;
+    VkImageLayout transferOldLayout;
+  };
+
+  static VkImageSubresourceRange wholeRange(const TrackedImage &tracked) {
+    VkImageSubresourceRange range = {};
+    range.aspectMask = tracked.aspects;
+    range.baseMipLevel = 0;
+    range.levelCount = tracked.levels;
+    range.baseArrayLayer = 0;
+    range.layerCount = tracked.layers;
+    return range;
+  }
+
+  std::unordered_map<VkImage, TrackedImage> images;
+
+  static void apply(SubresourceState &state, VkImageLayout layout,
+                    VkPipelineStageFlags stages, VkAccessFlags access) {
+    if (access & WRITE_ACCESS_MASK) {
+      state.writeStages = stages;
+      state.writeAccess = access & WRITE_ACCESS_MASK;
+      state.readStages = 0;
+      state.visibleStages = stages;
+      state.visibleAccess = access;
+    } else if (layout != state.layout) {
+      // The transition itself is a write that the barrier just made visible
+      // to these stages only.
+      state.writeStages = stages;
+      state.writeAccess = 0;
+      state.readStages = stages;
+      state.visibleStages = stages;
+      state.visibleAccess = access;
+    } else {
+      state.readStages |= stages;
+      state.visibleStages |= stages;
+      state.visibleAccess |= access;
+    }
+
+    state.layout = layout;
+  }
+
+  static bool needsBarrier(const SubresourceState &state, VkImageLayout layout,
+                           VkPipelineStageFlags stages, VkAccessFlags access,
+                           bool discard) {
+    if (layout != state.layout || discard) return true;
+
+    // Write-after-write and write-after-read.
+    if (access & WRITE_ACCESS_MASK)
+      return state.writeStages != 0 || state.readStages != 0;
+
+    // Read-after-read never needs a barrier. Read-after-write only needs one
+    // if the write has not yet been made visible to this stage and access.
+    if (state.writeStages == 0) return false;
+
+    return (state.visibleStages & stages) != stages ||
+           (state.visibleAccess & access) != access;
+  }
+
+  static VkImageMemoryBarrier barrierFor(VkImage image,
+                                         const SubresourceState &state,
+                                         const VkImageSubresourceRange &range,
+                                         VkImageLayout layout,
+                                         VkAccessFlags access, bool discard) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = state.writeAccess;
+    barrier.dstAccessMask = access;
+    barrier.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    return barrier;
+  }
+
+  static VkPipelineStageFlags srcStagesFor(const SubresourceState &state) {
+    VkPipelineStageFlags stages = state.writeStages | state.readStages;
+    return stages != 0
+               ? stages
+               : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+
+ public:
+  void track(VkImage image, VkImageAspectFlags aspects, uint32_t levels,
+             uint32_t layers, VkImageLayout layout,
+             uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED) {
+    TrackedImage &tracked = images[image];
+    tracked.aspects = aspects;
+    tracked.levels = levels;
+    tracked.layers = layers;
+    tracked.transferPending = false;
+
+    SubresourceState initial = {};
+    initial.layout = layout;
+    initial.queueFamily = queueFamily;
+    tracked.states.assign(levels * layers, initial);
+  }
+
+  void forget(VkImage image) { images.erase(image); }
+
+  bool isTracked(VkImage image) const {
+    return images.find(image) != images.end();
+  }
+
+  VkImageLayout layout(VkImage image, uint32_t level = 0,
+                       uint32_t layer = 0) const {
+    const TrackedImage &tracked = images.find(image)->second;
+    return tracked.states[level * tracked.layers + layer].layout;
+  }
+
+  // Records that the image became available through a semaphore waited on at
+  // `stages`, such as an acquired swapchain image. The layout is kept, but
+  // the next barrier will chain off those stages instead of earlier work.
+  void acquired(VkImage image, VkPipelineStageFlags stages) {
+    TrackedImage &tracked = images.find(image)->second;
+
+    for (uint32_t i = 0; i < tracked.states.size(); i++) {
+      SubresourceState &state = tracked.states[i];
+      state.writeStages = stages;
+      state.writeAccess = 0;
+      state.readStages = 0;
+      state.visibleStages = 0;
+      state.visibleAccess = 0;
+    }
+  }
+
+  // Makes `range` usable in `layout` by `stages` with `access`. Barriers
+  // are only queued for subresources that actually need one; a subresource
+  // already in the right state costs nothing. With `discard`, the current
+  // contents are not preserved, which lets the transition start from
+  // VK_IMAGE_LAYOUT_UNDEFINED.
+  void require(VulkanBarrierBatch &batch, VkImage image,
+               const VkImageSubresourceRange &range, VkImageLayout layout,
+               VkPipelineStageFlags stages, VkAccessFlags access,
+               bool discard = false) {
+    TrackedImage &tracked = images.find(image)->second;
+    assert(!tracked.transferPending);
+
+    uint32_t levelCount = range.levelCount == VK_REMAINING_MIP_LEVELS
+                              ? tracked.levels - range.baseMipLevel
+                              : range.levelCount;
+    uint32_t layerCount = range.layerCount == VK_REMAINING_ARRAY_LAYERS
+                              ? tracked.layers - range.baseArrayLayer
+                              : range.layerCount;
+
+    // The common case is a range whose subresources all share one state,
+    // which needs at most one barrier for the whole range.
+    const SubresourceState &first =
+        tracked.states[range.baseMipLevel * tracked.layers +
+                       range.baseArrayLayer];
+    bool uniform = true;
+
+    for (uint32_t level = 0; level < levelCount && uniform; level++)
+      for (uint32_t layer = 0; layer < layerCount && uniform; layer++)
+        uniform = tracked.states[(range.baseMipLevel + level) * tracked.layers +
+                                 range.baseArrayLayer + layer] == first;
+
+    if (uniform) {
+      if (needsBarrier(first, layout, stages, access, discard))
+        batch.addImageBarrier(
+            srcStagesFor(first), stages,
+            barrierFor(image, first, range, layout, access, discard));
+
+      SubresourceState updated = first;
+      apply(updated, layout, stages, access);
+
+      for (uint32_t level = 0; level < levelCount; level++)
+        for (uint32_t layer = 0; layer < layerCount; layer++)
+          tracked.states[(range.baseMipLevel + level) * tracked.layers +
+                         range.baseArrayLayer + layer] = updated;
+      return;
+    }
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+      for (uint32_t layer = 0; layer < layerCount; layer++) {
+        SubresourceState &state =
+            tracked.states[(range.baseMipLevel + level) * tracked.layers +
+                           range.baseArrayLayer + layer];
+
+        if (needsBarrier(state, layout, stages, access, discard)) {
+          VkImageSubresourceRange single = range;
+          single.baseMipLevel = range.baseMipLevel + level;
+          single.levelCount = 1;
+          single.baseArrayLayer = range.baseArrayLayer + layer;
+          single.layerCount = 1;
+          batch.addImageBarrier(
+              srcStagesFor(state), stages,
+              barrierFor(image, state, single, layout, access, discard));
+        }
+
+        apply(state, layout, stages, access);
+      }
+    }
+  }
+
+  // Whole-image variant using the default stages and accesses of `layout`.
+  void require(VulkanBarrierBatch &batch, VkImage image, VkImageLayout layout,
+               bool discard = false) {
+    const TrackedImage &tracked = images.find(image)->second;
+    VulkanTools::LayoutSync sync = VulkanTools::layoutDstSync(layout);
+    require(batch, image, wholeRange(tracked), layout, sync.stages,
+            sync.access, discard);
+  }
+
+  // Hands the whole image over to `dstFamily`, transitioning it to `layout`
+  // on the way. `batch` must be flushed into a command buffer for the
+  // family that currently owns the image, and acquire() into one for
+  // `dstFamily`, with a semaphore ordering the two submissions. The image
+  // must be in one state throughout.
+  void release(VulkanBarrierBatch &batch, VkImage image, uint32_t dstFamily,
+               VkImageLayout layout) {
+    TrackedImage &tracked = images.find(image)->second;
+    SubresourceState &first = tracked.states[0];
+
+    for (uint32_t i = 1; i < tracked.states.size(); i++)
+      assert(tracked.states[i] == first);
+
+    assert(first.queueFamily != VK_QUEUE_FAMILY_IGNORED);
+    assert(!tracked.transferPending);
+
+    VkImageMemoryBarrier barrier =
+        barrierFor(image, first, wholeRange(tracked), layout, 0, false);
+    barrier.srcQueueFamilyIndex = first.queueFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+    batch.addImageBarrier(srcStagesFor(first),
+                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, barrier);
+
+    tracked.transferPending = true;
+    tracked.transferSrcFamily = first.queueFamily;
+    tracked.transferOldLayout = first.layout;
+
+    // Nothing on the new queue has touched the image yet; the semaphore
+    // covers everything the old queue did.
+    SubresourceState released = {};
+    released.layout = layout;
+    released.queueFamily = dstFamily;
+    tracked.states.assign(tracked.states.size(), released);
+  }
+
+  // The second half of release(), recorded for the new owner. The image
+  // becomes usable by `stages` with `access`.
+  void acquire(VulkanBarrierBatch &batch, VkImage image,
+               VkPipelineStageFlags stages, VkAccessFlags access) {
+    TrackedImage &tracked = images.find(image)->second;
+    assert(tracked.transferPending);
+
+    SubresourceState &state = tracked.states[0];
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = NULL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = access;
+    barrier.oldLayout = tracked.transferOldLayout;
+    barrier.newLayout = state.layout;
+    barrier.srcQueueFamilyIndex = tracked.transferSrcFamily;
+    barrier.dstQueueFamilyIndex = state.queueFamily;
+    barrier.image = image;
+    barrier.subresourceRange = wholeRange(tracked);
+    batch.addImageBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, stages, barrier);
+
+    tracked.transferPending = false;
+
+    // The acquire performs the layout transition, which is a write made
+    // visible to `stages` only.
+    SubresourceState acquired = state;
+    acquired.writeStages = stages;
+    acquired.writeAccess = 0;
+    acquired.readStages = stages;
+    acquired.visibleStages = stages;
+    acquired.visibleAccess = access;
+    tracked.states.assign(tracked.states.size(), acquired);
+  }
+
+  // Takes the image over for `family` without an ownership transfer, which
+  // the spec allows when the contents are not needed: they become undefined
+  // and the next barrier starts from VK_IMAGE_LAYOUT_UNDEFINED. Whatever
+  // the previous owner did must already be complete, for example behind a
+  // fence the host waited on.
+  void claim(VkImage image, uint32_t family) {
+    TrackedImage &tracked = images.find(image)->second;
+    assert(!tracked.transferPending);
+
+    SubresourceState claimed = {};
+    claimed.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    claimed.queueFamily = family;
+    tracked.states.assign(tracked.states.size(), claimed);
+  }
+};
+
+#endif  // VULKAN_IMAGE_TRACKER_HPP
@@ -0,0 +1,119 @@
+#include "VulkanLoader.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#endif
+
+#include "VulkanTools.hpp"
+
+#if defined(_WIN32)
+#define VULKAN_LOADER_LIBRARY "vulkan-1.dll"
+#else
+#define VULKAN_LOADER_LIBRARY "libvulkan.so.1"
+#endif
+
+#if defined(VK_NO_PROTOTYPES)
+#define VULKAN_LOADER_DEFINE(name) PFN_vk##name vk##name;
+VULKAN_LOADER_DEFINE(GetInstanceProcAddr)
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOADER_DEFINE)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOADER_DEFINE)
+#undef VULKAN_LOADER_DEFINE
+
+static void *openLibrary(const char *name) {
+#if defined(_WIN32)
+  return (void *)LoadLibraryA(name);
+#else
+  return dlopen(name, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void *findSymbol(void *library, const char *name) {
+#if defined(_WIN32)
+  return (void *)GetProcAddress((HMODULE)library, name);
+#else
+  return dlsym(library, name);
+#endif
+}
+#endif
+
+void VulkanLoader::overrideDriver(const char *icdJson) {
+  if (icdJson == NULL || *icdJson == '\0') return;
+
+  FILE *file = fopen(icdJson, "r");
+
+  if (file == NULL) {
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Cannot read the driver manifest %s\n",
+             icdJson);
+    VulkanTools::exitOnError(msg);
+  }
+
+  fclose(file);
+
+  // The loader reads these when it first scans for drivers. Older loaders
+  // only know the first name.
+#if defined(_WIN32)
+  _putenv_s("VK_ICD_FILENAMES", icdJson);
+  _putenv_s("VK_DRIVER_FILES", icdJson);
+#else
+  setenv("VK_ICD_FILENAMES", icdJson, 1);
+  setenv("VK_DRIVER_FILES", icdJson, 1);
+#endif
+}
+
+void VulkanLoader::init(const char *library) {
+#if defined(VK_NO_PROTOTYPES)
+  bool defaultLibrary = library == NULL || *library == '\0';
+
+  if (defaultLibrary) library = VULKAN_LOADER_LIBRARY;
+
+  void *handle = openLibrary(library);
+
+#if !defined(_WIN32)
+  // Development installs often only provide the unversioned name.
+  if (handle == NULL && defaultLibrary)
+    handle = openLibrary("libvulkan.so");
+#endif
+
+  if (handle == NULL) {
+    char msg[512];
+    snprintf(msg, sizeof(msg),
+             "Cannot load the Vulkan loader (%s). Please make sure Vulkan is "
+             "installed before continuing.\n",
+             library);
+    VulkanTools::exitOnError(msg);
+  }
+
+  // The library stays open for the life of the process.
+  vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)findSymbol(
+      handle, "vkGetInstanceProcAddr");
+
+  if (!vkGetInstanceProcAddr)
+    VulkanTools::exitOnError(
+        "The Vulkan loader does not export vkGetInstanceProcAddr");
+
+#define VULKAN_LOADER_LOAD(name)                                      \
+  vk##name = (PFN_vk##name)vkGetInstanceProcAddr(NULL, "vk" #name); \
+  if (!vk##name)                                                      \
+    VulkanTools::exitOnError("vkGetInstanceProcAddr failed to find vk" #name);
+  VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOADER_LOAD)
+#undef VULKAN_LOADER_LOAD
+#else
+  (void)library;
+#endif
+}
+
+void VulkanLoader::loadInstance(VkInstance instance) {
+#if defined(VK_NO_PROTOTYPES)
+#define VULKAN_LOADER_LOAD(name)                                          \
+  vk##name = (PFN_vk##name)vkGetInstanceProcAddr(instance, "vk" #name); \
+  if (!vk##name)                                                          \
+    VulkanTools::exitOnError("vkGetInstanceProcAddr failed to find vk" #name);
+  VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOADER_LOAD)
+#undef VULKAN_LOADER_LOAD
+#else
+  (void)instance;
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef VULKAN_LOADER_HPP
+#define VULKAN_LOADER_HPP
+
+#include <vulkan/vulkan.h>
+
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+#define VULKAN_PLATFORM_SURFACE_FUNCTIONS(X) X(CreateWin32SurfaceKHR)
+#elif defined(VK_USE_PLATFORM_XCB_KHR)
+#define VULKAN_PLATFORM_SURFACE_FUNCTIONS(X) X(CreateXcbSurfaceKHR)
+#else
+#define VULKAN_PLATFORM_SURFACE_FUNCTIONS(X)
+#endif
+
+// Global and instance-level entry points the example calls directly. Device
+// functions go through `vkd` instead.
+#define VULKAN_GLOBAL_FUNCTIONS(X) \
+  X(CreateInstance)                \
+  X(EnumerateInstanceExtensionProperties)
+
+#define VULKAN_INSTANCE_FUNCTIONS(X)        \
+  X(CreateDevice)                           \
+  X(DestroyInstance)                        \
+  X(DestroySurfaceKHR)                      \
+  X(EnumerateDeviceExtensionProperties)     \
+  X(EnumeratePhysicalDevices)               \
+  X(GetDeviceProcAddr)                      \
+  X(GetPhysicalDeviceMemoryProperties)      \
+  X(GetPhysicalDeviceProperties)            \
+  X(GetPhysicalDeviceQueueFamilyProperties) \
+  VULKAN_PLATFORM_SURFACE_FUNCTIONS(X)
+
+// Built with VK_NO_PROTOTYPES the example does not link against the Vulkan
+// loader at all. init() opens it at runtime and every vk* name above becomes
+// a function pointer, so a machine without Vulkan gets an error message
+// instead of a dynamic linker failure, and device calls skip the loader's
+// exported trampolines entirely.
+//
+// Without VK_NO_PROTOTYPES the pointers do not exist and init() does nothing.
+#if defined(VK_NO_PROTOTYPES)
+#define VULKAN_LOADER_DECLARE(name) extern PFN_vk##name vk##name;
+VULKAN_LOADER_DECLARE(GetInstanceProcAddr)
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOADER_DECLARE)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOADER_DECLARE)
+#undef VULKAN_LOADER_DECLARE
+#endif
+
+namespace VulkanLoader {
+// Makes the loader use the driver manifest `icdJson` instead of the
+// installed ones. Changes the environment, so call it before other threads
+// start and before any Vulkan call. NULL or empty leaves the drivers alone.
+void overrideDriver(const char *icdJson);
+
+// Must run before any other Vulkan call. `library` names the loader to open,
+// or NULL for the system one. Exits with a message if Vulkan cannot be
+// loaded.
+void init(const char *library);
+
+// Resolves the instance-level entry points for `instance`.
+void loadInstance(VkInstance instance);
+}
+
+#endif  // VULKAN_LOADER_HPP
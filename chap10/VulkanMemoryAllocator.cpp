@@ -0,0 +1,630 @@
+#include "VulkanMemoryAllocator.hpp"
+
+#include <cassert>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanHostAllocator.hpp"
+#include "VulkanTools.hpp"
+
+#define MEMORY_GRANULE (1ULL << MEMORY_GRANULE_SHIFT)
+#define NO_NODE UINT32_MAX
+
+static uint32_t findMsb(uint32_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, value);
+  return index;
+#else
+  return 31 - __builtin_clz(value);
+#endif
+}
+
+static uint32_t findLsb(uint32_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return index;
+#else
+  return __builtin_ctz(value);
+#endif
+}
+
+// Sizes below TLSF_SL_COUNT granules get a list each; above that the first
+// level is the highest set bit and the second level the next
+// TLSF_SL_SHIFT bits.
+static void mapping(uint32_t size, uint32_t &fl, uint32_t &sl) {
+  if (size < TLSF_SL_COUNT) {
+    fl = 0;
+    sl = size;
+    return;
+  }
+
+  uint32_t msb = findMsb(size);
+  fl = msb - TLSF_SL_SHIFT + 1;
+  sl = (size >> (msb - TLSF_SL_SHIFT)) ^ TLSF_SL_COUNT;
+}
+
+// The list to start searching at for `size` granules aligned to `alignment`
+// granules. The size is rounded up so that any range in that list or above
+// fits the request plus the worst case alignment padding.
+static bool searchClass(uint32_t size, uint32_t alignment, uint32_t &fl,
+                        uint32_t &sl) {
+  uint32_t search = size + alignment - 1;
+
+  if (search >= TLSF_SL_COUNT)
+    search += (1u << (findMsb(search) - TLSF_SL_SHIFT)) - 1;
+
+  mapping(search, fl, sl);
+  return fl < TLSF_FL_COUNT;
+}
+
+// Moves (fl, sl) to the first non-empty list at or above it.
+static bool findClass(uint32_t flBitmap, const uint32_t *slBitmap,
+                      uint32_t &fl, uint32_t &sl) {
+  uint32_t slMap = slBitmap[fl] & (~0u << sl);
+
+  if (slMap == 0) {
+    uint32_t flMap = fl + 1 < TLSF_FL_COUNT ? flBitmap & (~0u << (fl + 1)) : 0;
+
+    if (flMap == 0) return false;
+
+    fl = findLsb(flMap);
+    slMap = slBitmap[fl];
+  }
+
+  sl = findLsb(slMap);
+  return true;
+}
+
+TlsfRange::TlsfRange() : unusedNodes(NO_NODE), flBitmap(0), usedSize(0) {}
+
+void TlsfRange::init(uint32_t size) {
+  nodes.clear();
+  unusedNodes = NO_NODE;
+  flBitmap = 0;
+  usedSize = 0;
+
+  for (uint32_t fl = 0; fl < TLSF_FL_COUNT; fl++) {
+    slBitmap[fl] = 0;
+
+    for (uint32_t sl = 0; sl < TLSF_SL_COUNT; sl++) heads[fl][sl] = NO_NODE;
+  }
+
+  uint32_t node = newNode();
+  nodes[node].offset = 0;
+  nodes[node].size = size;
+  nodes[node].prevPhysical = NO_NODE;
+  nodes[node].nextPhysical = NO_NODE;
+  insertFree(node);
+}
+
+uint32_t TlsfRange::newNode() {
+  if (unusedNodes == NO_NODE) {
+    nodes.push_back(Node());
+    return (uint32_t)nodes.size() - 1;
+  }
+
+  uint32_t node = unusedNodes;
+  unusedNodes = nodes[node].nextFree;
+  return node;
+}
+
+void TlsfRange::insertFree(uint32_t node) {
+  uint32_t fl, sl;
+  mapping(nodes[node].size, fl, sl);
+
+  uint32_t head = heads[fl][sl];
+  nodes[node].free = true;
+  nodes[node].prevFree = NO_NODE;
+  nodes[node].nextFree = head;
+
+  if (head != NO_NODE) nodes[head].prevFree = node;
+
+  heads[fl][sl] = node;
+  flBitmap |= 1u << fl;
+  slBitmap[fl] |= 1u << sl;
+}
+
+void TlsfRange::removeFree(uint32_t node) {
+  uint32_t fl, sl;
+  mapping(nodes[node].size, fl, sl);
+
+  uint32_t prev = nodes[node].prevFree;
+  uint32_t next = nodes[node].nextFree;
+
+  if (prev != NO_NODE) nodes[prev].nextFree = next;
+
+  if (next != NO_NODE) nodes[next].prevFree = prev;
+
+  if (heads[fl][sl] == node) {
+    heads[fl][sl] = next;
+
+    if (next == NO_NODE) {
+      slBitmap[fl] &= ~(1u << sl);
+
+      if (slBitmap[fl] == 0) flBitmap &= ~(1u << fl);
+    }
+  }
+
+  nodes[node].free = false;
+}
+
+// Absorbs `next`, the physical successor of `node`, and recycles it.
+void TlsfRange::merge(uint32_t node, uint32_t next) {
+  uint32_t after = nodes[next].nextPhysical;
+  nodes[node].size += nodes[next].size;
+  nodes[node].nextPhysical = after;
+
+  if (after != NO_NODE) nodes[after].prevPhysical = node;
+
+  nodes[next].nextFree = unusedNodes;
+  unusedNodes = next;
+}
+
+uint32_t TlsfRange::allocate(uint32_t size, uint32_t alignment) {
+  assert(size > 0 && (alignment & (alignment - 1)) == 0);
+
+  uint32_t fl, sl;
+
+  if (!searchClass(size, alignment, fl, sl) ||
+      !findClass(flBitmap, slBitmap, fl, sl))
+    return NO_NODE;
+
+  uint32_t node = heads[fl][sl];
+  removeFree(node);
+
+  // Free ranges never border each other, so the pieces split off here
+  // cannot be merged with anything.
+  uint32_t offset = nodes[node].offset;
+  uint32_t padding = ((offset + alignment - 1) & ~(alignment - 1)) - offset;
+
+  if (padding > 0) {
+    uint32_t front = newNode();
+    uint32_t before = nodes[node].prevPhysical;
+    nodes[front].offset = offset;
+    nodes[front].size = padding;
+    nodes[front].prevPhysical = before;
+    nodes[front].nextPhysical = node;
+
+    if (before != NO_NODE) nodes[before].nextPhysical = front;
+
+    nodes[node].prevPhysical = front;
+    nodes[node].offset += padding;
+    nodes[node].size -= padding;
+    insertFree(front);
+  }
+
+  if (nodes[node].size > size) {
+    uint32_t back = newNode();
+    uint32_t after = nodes[node].nextPhysical;
+    nodes[back].offset = nodes[node].offset + size;
+    nodes[back].size = nodes[node].size - size;
+    nodes[back].prevPhysical = node;
+    nodes[back].nextPhysical = after;
+
+    if (after != NO_NODE) nodes[after].prevPhysical = back;
+
+    nodes[node].nextPhysical = back;
+    nodes[node].size = size;
+    insertFree(back);
+  }
+
+  usedSize += size;
+  return node;
+}
+
+void TlsfRange::free(uint32_t node) {
+  assert(!nodes[node].free);
+  usedSize -= nodes[node].size;
+
+  uint32_t prev = nodes[node].prevPhysical;
+
+  if (prev != NO_NODE && nodes[prev].free) {
+    removeFree(prev);
+    merge(prev, node);
+    node = prev;
+  }
+
+  uint32_t next = nodes[node].nextPhysical;
+
+  if (next != NO_NODE && nodes[next].free) {
+    removeFree(next);
+    merge(node, next);
+  }
+
+  insertFree(node);
+}
+
+bool TlsfRange::largestClass(uint32_t &fl, uint32_t &sl) const {
+  if (flBitmap == 0) return false;
+
+  fl = findMsb(flBitmap);
+  sl = findMsb(slBitmap[fl]);
+  return true;
+}
+
+VulkanMemoryAllocator::Pool::Pool()
+    : memoryType(0), liveBlocks(0), flBitmap(0) {
+  for (uint32_t fl = 0; fl < TLSF_FL_COUNT; fl++) {
+    slBitmap[fl] = 0;
+
+    for (uint32_t sl = 0; sl < TLSF_SL_COUNT; sl++) heads[fl][sl] = NO_NODE;
+  }
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator()
+    : device(VK_NULL_HANDLE),
+      blockSize(MEMORY_BLOCK_SIZE),
+      maxAllocations(0),
+      deviceAllocations(0),
+      separateKinds(false) {}
+
+void VulkanMemoryAllocator::init(VkPhysicalDevice physicalDevice,
+                                 VkDevice device, VkDeviceSize blockSize) {
+  this->device = device;
+  this->blockSize = blockSize & ~(MEMORY_GRANULE - 1);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  maxAllocations = properties.limits.maxMemoryAllocationCount;
+  separateKinds = properties.limits.bufferImageGranularity > MEMORY_GRANULE;
+
+  pools.resize(memoryProperties.memoryTypeCount * 2);
+
+  for (uint32_t i = 0; i < pools.size(); i++) pools[i].memoryType = i / 2;
+
+  heapStats.resize(memoryProperties.memoryHeapCount);
+
+  for (uint32_t i = 0; i < heapStats.size(); i++) {
+    MemoryHeapStats &stats = heapStats[i];
+    stats.heapSize = memoryProperties.memoryHeaps[i].size;
+    stats.blockBytes = 0;
+    stats.usedBytes = 0;
+    stats.blockCount = 0;
+    stats.allocationCount = 0;
+  }
+}
+
+void VulkanMemoryAllocator::destroy() {
+  for (uint32_t p = 0; p < pools.size(); p++) {
+    Pool &pool = pools[p];
+
+    for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+      Block *block = pool.blocks[b];
+
+      if (block == NULL) continue;
+
+      vkd.FreeMemory(device, block->memory,
+                     hostAllocator.callbacks(HOST_OBJECT_DEVICE_MEMORY));
+      delete block;
+    }
+  }
+
+  pools.clear();
+  deviceAllocations = 0;
+}
+
+uint32_t VulkanMemoryAllocator::findMemoryType(
+    uint32_t typeBits, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred) const {
+  uint32_t fallback = UINT32_MAX;
+
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+
+    if ((typeBits & (1u << i)) == 0 || (flags & required) != required)
+      continue;
+
+    if ((flags & preferred) == preferred) return i;
+
+    if (fallback == UINT32_MAX) fallback = i;
+  }
+
+  return fallback;
+}
+
+bool VulkanMemoryAllocator::allocateMemory(uint32_t memoryType,
+                                           VkDeviceSize size,
+                                           VkDeviceMemory &memory,
+                                           uint8_t *&mapped) {
+  if (deviceAllocations >= maxAllocations) return false;
+
+  VkMemoryAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = NULL;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  if (vkd.AllocateMemory(device, &allocInfo,
+                         hostAllocator.callbacks(HOST_OBJECT_DEVICE_MEMORY),
+                         &memory) != VK_SUCCESS)
+    return false;
+
+  mapped = NULL;
+
+  if (memoryProperties.memoryTypes[memoryType].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    void *data;
+    VkResult result =
+        vkd.MapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+    assert(result == VK_SUCCESS);
+    mapped = (uint8_t *)data;
+  }
+
+  MemoryHeapStats &stats =
+      heapStats[memoryProperties.memoryTypes[memoryType].heapIndex];
+  stats.blockBytes += size;
+  stats.blockCount++;
+  deviceAllocations++;
+  return true;
+}
+
+// Freeing the memory also unmaps it.
+void VulkanMemoryAllocator::freeMemory(uint32_t memoryType, VkDeviceSize size,
+                                       VkDeviceMemory memory) {
+  vkd.FreeMemory(device, memory,
+                 hostAllocator.callbacks(HOST_OBJECT_DEVICE_MEMORY));
+
+  MemoryHeapStats &stats =
+      heapStats[memoryProperties.memoryTypes[memoryType].heapIndex];
+  stats.blockBytes -= size;
+  stats.blockCount--;
+  deviceAllocations--;
+}
+
+// Files block `b` under the list of its largest free range. A full block is
+// left out, since nothing could be allocated from it.
+void VulkanMemoryAllocator::linkBlock(Pool &pool, uint32_t b) {
+  Block *block = pool.blocks[b];
+  uint32_t fl, sl;
+
+  block->listed = block->range.largestClass(fl, sl);
+
+  if (!block->listed) return;
+
+  uint32_t head = pool.heads[fl][sl];
+  block->fl = fl;
+  block->sl = sl;
+  block->prevFree = NO_NODE;
+  block->nextFree = head;
+
+  if (head != NO_NODE) pool.blocks[head]->prevFree = b;
+
+  pool.heads[fl][sl] = b;
+  pool.flBitmap |= 1u << fl;
+  pool.slBitmap[fl] |= 1u << sl;
+}
+
+void VulkanMemoryAllocator::unlinkBlock(Pool &pool, uint32_t b) {
+  Block *block = pool.blocks[b];
+
+  if (!block->listed) return;
+
+  uint32_t prev = block->prevFree;
+  uint32_t next = block->nextFree;
+
+  if (prev != NO_NODE) pool.blocks[prev]->nextFree = next;
+
+  if (next != NO_NODE) pool.blocks[next]->prevFree = prev;
+
+  if (pool.heads[block->fl][block->sl] == b) {
+    pool.heads[block->fl][block->sl] = next;
+
+    if (next == NO_NODE) {
+      pool.slBitmap[block->fl] &= ~(1u << block->sl);
+
+      if (pool.slBitmap[block->fl] == 0) pool.flBitmap &= ~(1u << block->fl);
+    }
+  }
+
+  block->listed = false;
+}
+
+bool VulkanMemoryAllocator::allocateFromPool(uint32_t poolIndex,
+                                             uint32_t granules,
+                                             uint32_t alignment,
+                                             MemoryAllocation &allocation) {
+  Pool &pool = pools[poolIndex];
+  uint32_t b = NO_NODE;
+  uint32_t fl, sl;
+
+  // Every block in the list found has a free range that the block's own
+  // search will find too, so the allocation below cannot fail.
+  if (searchClass(granules, alignment, fl, sl) &&
+      findClass(pool.flBitmap, pool.slBitmap, fl, sl))
+    b = pool.heads[fl][sl];
+
+  if (b == NO_NODE) {
+    Block *block = new Block();
+
+    if (!allocateMemory(pool.memoryType, blockSize, block->memory,
+                        block->mapped)) {
+      delete block;
+      return false;
+    }
+
+    block->range.init((uint32_t)(blockSize >> MEMORY_GRANULE_SHIFT));
+    block->allocationCount = 0;
+    block->listed = false;
+
+    if (pool.emptySlots.empty()) {
+      b = (uint32_t)pool.blocks.size();
+      pool.blocks.push_back(block);
+    } else {
+      b = pool.emptySlots.back();
+      pool.emptySlots.pop_back();
+      pool.blocks[b] = block;
+    }
+
+    pool.liveBlocks++;
+  }
+
+  Block *block = pool.blocks[b];
+  unlinkBlock(pool, b);
+  uint32_t node = block->range.allocate(granules, alignment);
+  assert(node != NO_NODE);
+  linkBlock(pool, b);
+
+  block->allocationCount++;
+  allocation.memory = block->memory;
+  allocation.offset = (VkDeviceSize)block->range.offset(node)
+                      << MEMORY_GRANULE_SHIFT;
+  allocation.mapped =
+      block->mapped != NULL ? block->mapped + allocation.offset : NULL;
+  allocation.block = b;
+  allocation.node = node;
+  return true;
+}
+
+bool VulkanMemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     VkMemoryPropertyFlags required,
+                                     VkMemoryPropertyFlags preferred,
+                                     MemoryResourceKind kind,
+                                     MemoryAllocation &allocation) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  uint32_t memoryType =
+      findMemoryType(requirements.memoryTypeBits, required, preferred);
+
+  if (memoryType == UINT32_MAX) return false;
+
+  MemoryHeapStats &stats =
+      heapStats[memoryProperties.memoryTypes[memoryType].heapIndex];
+  allocation.memoryType = memoryType;
+  allocation.size = requirements.size;
+
+  // Big resources would mostly waste a shared block.
+  if (requirements.size > blockSize / 2) {
+    uint8_t *mapped;
+
+    if (!allocateMemory(memoryType, requirements.size, allocation.memory,
+                        mapped))
+      return false;
+
+    allocation.offset = 0;
+    allocation.mapped = mapped;
+    allocation.pool = UINT32_MAX;
+    allocation.block = UINT32_MAX;
+    allocation.node = NO_NODE;
+    stats.usedBytes += requirements.size;
+    stats.allocationCount++;
+    return true;
+  }
+
+  uint32_t granules = (uint32_t)((requirements.size + MEMORY_GRANULE - 1) >>
+                                 MEMORY_GRANULE_SHIFT);
+  uint32_t alignment =
+      requirements.alignment > MEMORY_GRANULE
+          ? (uint32_t)(requirements.alignment >> MEMORY_GRANULE_SHIFT)
+          : 1;
+
+  allocation.pool = memoryType * 2 + (separateKinds ? kind : MEMORY_LINEAR);
+
+  if (!allocateFromPool(allocation.pool, granules, alignment, allocation))
+    return false;
+
+  stats.usedBytes += (VkDeviceSize)granules << MEMORY_GRANULE_SHIFT;
+  stats.allocationCount++;
+  return true;
+}
+
+void VulkanMemoryAllocator::free(MemoryAllocation &allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  MemoryHeapStats &stats =
+      heapStats[memoryProperties.memoryTypes[allocation.memoryType].heapIndex];
+  stats.allocationCount--;
+
+  if (allocation.node == NO_NODE) {
+    freeMemory(allocation.memoryType, allocation.size, allocation.memory);
+    stats.usedBytes -= allocation.size;
+    allocation.memory = VK_NULL_HANDLE;
+    return;
+  }
+
+  Pool &pool = pools[allocation.pool];
+  Block *block = pool.blocks[allocation.block];
+  stats.usedBytes -= (VkDeviceSize)block->range.size(allocation.node)
+                     << MEMORY_GRANULE_SHIFT;
+  unlinkBlock(pool, allocation.block);
+  block->range.free(allocation.node);
+  block->allocationCount--;
+  allocation.memory = VK_NULL_HANDLE;
+
+  // Keep one empty block per pool around so a resource that is created and
+  // destroyed repeatedly does not allocate device memory every time.
+  if (block->allocationCount > 0 || pool.liveBlocks == 1) {
+    linkBlock(pool, allocation.block);
+    return;
+  }
+
+  freeMemory(pool.memoryType, blockSize, block->memory);
+  delete block;
+  pool.blocks[allocation.block] = NULL;
+  pool.emptySlots.push_back(allocation.block);
+  pool.liveBlocks--;
+}
+
+MemoryAllocation VulkanMemoryAllocator::allocateBuffer(
+    VkBuffer buffer, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred) {
+  VkMemoryRequirements requirements;
+  vkd.GetBufferMemoryRequirements(device, buffer, &requirements);
+
+  MemoryAllocation allocation;
+
+  if (!allocate(requirements, required, preferred, MEMORY_LINEAR, allocation))
+    VulkanTools::exitOnError("Out of device memory for a buffer");
+
+  VkResult result = vkd.BindBufferMemory(device, buffer, allocation.memory,
+                                         allocation.offset);
+  assert(result == VK_SUCCESS);
+  return allocation;
+}
+
+MemoryAllocation VulkanMemoryAllocator::allocateImage(
+    VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred) {
+  VkMemoryRequirements requirements;
+  vkd.GetImageMemoryRequirements(device, image, &requirements);
+
+  MemoryResourceKind kind =
+      tiling == VK_IMAGE_TILING_OPTIMAL ? MEMORY_OPTIMAL : MEMORY_LINEAR;
+  MemoryAllocation allocation;
+
+  if (!allocate(requirements, required, preferred, kind, allocation))
+    VulkanTools::exitOnError("Out of device memory for an image");
+
+  VkResult result = vkd.BindImageMemory(device, image, allocation.memory,
+                                        allocation.offset);
+  assert(result == VK_SUCCESS);
+  return allocation;
+}
+
+MemoryHeapStats VulkanMemoryAllocator::heapStatsFor(uint32_t heap) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return heapStats[heap];
+}
+
+void VulkanMemoryAllocator::printStats(FILE *file) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (uint32_t i = 0; i < heapStats.size(); i++) {
+    const MemoryHeapStats &stats = heapStats[i];
+
+    fprintf(file,
+            "Heap %u: %llu of %llu MiB in %u blocks, %llu KiB used by %u "
+            "allocations\n",
+            i, (unsigned long long)(stats.blockBytes >> 20),
+            (unsigned long long)(stats.heapSize >> 20), stats.blockCount,
+            (unsigned long long)(stats.usedBytes >> 10),
+            stats.allocationCount);
+  }
+}
@@ -0,0 +1,183 @@
+#ifndef VULKAN_MEMORY_ALLOCATOR_HPP
+#define VULKAN_MEMORY_ALLOCATOR_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <vector>
+
+#define MEMORY_BLOCK_SIZE (64ULL << 20)
+// Sub-allocations are made in whole granules, so every offset is at least
+// this aligned.
+#define MEMORY_GRANULE_SHIFT 8
+#define TLSF_SL_SHIFT 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_SHIFT)
+#define TLSF_FL_COUNT 32
+
+// Two-level segregated fit over one range of granules. Free ranges sit in
+// lists indexed by the top bits of their size, and two bitmaps say which
+// lists are non-empty, so finding, splitting and merging are all O(1).
+// Ranges are addressed by node index; nodes are recycled rather than freed.
+class TlsfRange {
+ private:
+  struct Node {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t prevPhysical;
+    uint32_t nextPhysical;
+    uint32_t prevFree;
+    uint32_t nextFree;
+    bool free;
+  };
+
+  std::vector<Node> nodes;
+  uint32_t unusedNodes;
+  uint32_t flBitmap;
+  uint32_t slBitmap[TLSF_FL_COUNT];
+  uint32_t heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+  uint32_t usedSize;
+
+  uint32_t newNode();
+  void insertFree(uint32_t node);
+  void removeFree(uint32_t node);
+  void merge(uint32_t node, uint32_t next);
+
+ public:
+  TlsfRange();
+
+  void init(uint32_t size);
+
+  // Returns the node for `size` granules aligned to `alignment` granules,
+  // or UINT32_MAX if no free range is large enough.
+  uint32_t allocate(uint32_t size, uint32_t alignment);
+  void free(uint32_t node);
+
+  // The list holding the largest free range. False when nothing is free.
+  bool largestClass(uint32_t &fl, uint32_t &sl) const;
+
+  uint32_t offset(uint32_t node) const { return nodes[node].offset; }
+  uint32_t size(uint32_t node) const { return nodes[node].size; }
+  uint32_t used() const { return usedSize; }
+};
+
+struct MemoryAllocation {
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  // Points at `offset` when the memory is host visible, NULL otherwise.
+  void *mapped;
+  uint32_t memoryType;
+  uint32_t pool;
+  uint32_t block;
+  // UINT32_MAX for allocations with a VkDeviceMemory of their own.
+  uint32_t node;
+};
+
+struct MemoryHeapStats {
+  VkDeviceSize heapSize;
+  VkDeviceSize blockBytes;
+  VkDeviceSize usedBytes;
+  uint32_t blockCount;
+  uint32_t allocationCount;
+};
+
+// Linear resources are buffers and linearly tiled images; optimal ones are
+// optimally tiled images. They must not share a bufferImageGranularity page.
+enum MemoryResourceKind { MEMORY_LINEAR = 0, MEMORY_OPTIMAL = 1 };
+
+// Sub-allocates buffers and images from MEMORY_BLOCK_SIZE blocks of device
+// memory, one set of blocks per memory type, so the number of
+// vkAllocateMemory calls stays far below maxMemoryAllocationCount. Each
+// block is managed by a TlsfRange. Host-visible blocks stay mapped for
+// their whole life. Requests larger than half a block get a
+// VkDeviceMemory of their own.
+//
+// When bufferImageGranularity is larger than a granule, linear and optimal
+// resources get separate blocks; otherwise granule alignment already keeps
+// them on separate pages.
+//
+// Each pool files its blocks in TLSF lists by their largest free range, so
+// picking a block that fits is O(1) however many blocks the pool has.
+class VulkanMemoryAllocator {
+ private:
+  struct Block {
+    VkDeviceMemory memory;
+    uint8_t *mapped;
+    TlsfRange range;
+    uint32_t allocationCount;
+    // The pool list the block is in, if `listed`.
+    bool listed;
+    uint32_t fl;
+    uint32_t sl;
+    uint32_t prevFree;
+    uint32_t nextFree;
+  };
+
+  struct Pool {
+    uint32_t memoryType;
+    std::vector<Block *> blocks;
+    // Indices in `blocks` whose block has been freed.
+    std::vector<uint32_t> emptySlots;
+    uint32_t liveBlocks;
+    uint32_t flBitmap;
+    uint32_t slBitmap[TLSF_FL_COUNT];
+    uint32_t heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    Pool();
+  };
+
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  VkDeviceSize blockSize;
+  uint32_t maxAllocations;
+  uint32_t deviceAllocations;
+  bool separateKinds;
+  std::vector<Pool> pools;
+  std::vector<MemoryHeapStats> heapStats;
+  std::mutex mutex;
+
+  bool allocateMemory(uint32_t memoryType, VkDeviceSize size,
+                      VkDeviceMemory &memory, uint8_t *&mapped);
+  void freeMemory(uint32_t memoryType, VkDeviceSize size,
+                  VkDeviceMemory memory);
+  void linkBlock(Pool &pool, uint32_t b);
+  void unlinkBlock(Pool &pool, uint32_t b);
+  bool allocateFromPool(uint32_t poolIndex, uint32_t granules,
+                        uint32_t alignment, MemoryAllocation &allocation);
+
+ public:
+  VulkanMemoryAllocator();
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            VkDeviceSize blockSize = MEMORY_BLOCK_SIZE);
+  void destroy();
+
+  // Returns a memory type allowed by `typeBits` with all of `required`,
+  // preferring one that also has `preferred`, or UINT32_MAX.
+  uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required,
+                          VkMemoryPropertyFlags preferred = 0) const;
+
+  const VkPhysicalDeviceMemoryProperties &properties() const {
+    return memoryProperties;
+  }
+
+  bool allocate(const VkMemoryRequirements &requirements,
+                VkMemoryPropertyFlags required,
+                VkMemoryPropertyFlags preferred, MemoryResourceKind kind,
+                MemoryAllocation &allocation);
+  void free(MemoryAllocation &allocation);
+
+  // Allocate and bind in one step. Exit if no memory is left.
+  MemoryAllocation allocateBuffer(VkBuffer buffer,
+                                  VkMemoryPropertyFlags required,
+                                  VkMemoryPropertyFlags preferred = 0);
+  MemoryAllocation allocateImage(VkImage image, VkImageTiling tiling,
+                                 VkMemoryPropertyFlags required,
+                                 VkMemoryPropertyFlags preferred = 0);
+
+  MemoryHeapStats heapStatsFor(uint32_t heap);
+  void printStats(FILE *file);
+};
+
+#endif  // VULKAN_MEMORY_ALLOCATOR_HPP
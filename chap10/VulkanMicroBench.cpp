@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vulkan/vulkan.h>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "VulkanCommandAllocator.hpp"
+#include "VulkanDeviceTable.hpp"
+#include "VulkanLoader.hpp"
+#include "VulkanTools.hpp"
+
+// Times single Vulkan calls in tight loops, with no window, present or frame
+// pacing in the way. Run it through `make bench`, or directly:
+//
+//   VulkanMicroBench [suite...]
+//
+// Suites:
+//   pool      resetting a pool's command buffers one by one or all at once
+//   dispatch  vkCmdPipelineBarrier through the device dispatch table against
+//             the loader trampolines
+//
+// Select the driver with VK_ICD_JSON. The mock ICD makes the driver side of
+// every call almost free, which leaves the cost being compared. BENCH_ROUNDS
+// sets the rounds per case.
+
+#define POOL_BENCH_BUFFERS 256
+#define POOL_BENCH_ROUNDS 1000
+#define DISPATCH_BENCH_CALLS 10000
+#define DISPATCH_BENCH_ROUNDS 100
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchDevice {
+  VkInstance instance;
+  VkDevice device;
+  uint32_t queueFamily;
+};
+
+static double nanoseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::nano>(duration).count();
+}
+
+static double microseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+static BenchDevice createDevice() {
+  BenchDevice bench = {};
+
+  VkApplicationInfo appInfo = {};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pNext = NULL;
+  appInfo.pApplicationName = "VulkanMicroBench";
+  appInfo.pEngineName = ENGINE_NAME;
+  appInfo.apiVersion = VK_MAKE_VERSION(1, 0, 3);
+
+  VkInstanceCreateInfo instanceInfo = {};
+  instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceInfo.pNext = NULL;
+  instanceInfo.flags = 0;
+  instanceInfo.pApplicationInfo = &appInfo;
+
+  if (vkCreateInstance(&instanceInfo, NULL, &bench.instance) != VK_SUCCESS)
+    VulkanTools::exitOnError("The call to vkCreateInstance failed.\n");
+
+  VulkanLoader::loadInstance(bench.instance);
+
+  uint32_t count = 1;
+  VkPhysicalDevice physicalDevice;
+  VkResult result =
+      vkEnumeratePhysicalDevices(bench.instance, &count, &physicalDevice);
+
+  if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || count == 0)
+    VulkanTools::exitOnError("No Vulkan device found.\n");
+
+  bench.queueFamily =
+      VulkanTools::findQueueFamilies(physicalDevice).graphics;
+
+  float priority = 1.0f;
+  VkDeviceQueueCreateInfo queueInfo = {};
+  queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueInfo.pNext = NULL;
+  queueInfo.flags = 0;
+  queueInfo.queueFamilyIndex = bench.queueFamily;
+  queueInfo.queueCount = 1;
+  queueInfo.pQueuePriorities = &priority;
+
+  VkDeviceCreateInfo deviceInfo = {};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.pNext = NULL;
+  deviceInfo.flags = 0;
+  deviceInfo.queueCreateInfoCount = 1;
+  deviceInfo.pQueueCreateInfos = &queueInfo;
+
+  result = vkCreateDevice(physicalDevice, &deviceInfo, NULL, &bench.device);
+  assert(result == VK_SUCCESS);
+
+  vkd.load(bench.instance, bench.device);
+  return bench;
+}
+
+static void destroyDevice(BenchDevice &bench) {
+  vkd.DestroyDevice(bench.device, NULL);
+  vkDestroyInstance(bench.instance, NULL);
+}
+
+// A command buffer with a little in it, so a reset has something to free.
+static void recordBarrier(VkCommandBuffer cmdBuffer) {
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = NULL;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult result = vkd.BeginCommandBuffer(cmdBuffer, &beginInfo);
+  assert(result == VK_SUCCESS);
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkd.CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                         NULL, 0, NULL);
+
+  result = vkd.EndCommandBuffer(cmdBuffer);
+  assert(result == VK_SUCCESS);
+}
+
+// Every round resets the pool's POOL_BENCH_BUFFERS buffers and records them
+// again. The first round only allocates them and is not counted.
+static void benchPool(const BenchDevice &bench, const char *label,
+                      bool perBufferReset, uint32_t rounds) {
+  VulkanCommandAllocator commands;
+  commands.init(bench.device, bench.queueFamily, 1, perBufferReset);
+
+  Clock::duration resetTime = Clock::duration::zero();
+  Clock::time_point start = Clock::now();
+
+  for (uint32_t round = 0; round <= rounds; round++) {
+    if (round == 1) {
+      resetTime = Clock::duration::zero();
+      start = Clock::now();
+    }
+
+    Clock::time_point resetStart = Clock::now();
+    commands.reset(0);
+    resetTime += Clock::now() - resetStart;
+
+    for (uint32_t i = 0; i < POOL_BENCH_BUFFERS; i++)
+      recordBarrier(commands.allocate(0));
+  }
+
+  Clock::duration total = Clock::now() - start;
+  commands.destroy();
+
+  fprintf(stdout, "%-28s %10.2f us per reset %10.2f us per round\n", label,
+          microseconds(resetTime) / rounds, microseconds(total) / rounds);
+}
+
+// Records DISPATCH_BENCH_CALLS barriers per round into one command buffer,
+// calling through `table`. Only the barrier calls are timed.
+static void benchDispatch(const BenchDevice &bench, const char *label,
+                          bool throughLoader, uint32_t rounds) {
+  VulkanDeviceTable table;
+  table.load(bench.instance, bench.device, throughLoader);
+
+  VulkanCommandAllocator commands;
+  commands.init(bench.device, bench.queueFamily, 1, false);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = NULL;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = NULL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  Clock::duration callTime = Clock::duration::zero();
+
+  for (uint32_t round = 0; round < rounds; round++) {
+    commands.reset(0);
+    VkCommandBuffer cmdBuffer = commands.allocate(0);
+
+    VkResult result = vkd.BeginCommandBuffer(cmdBuffer, &beginInfo);
+    assert(result == VK_SUCCESS);
+
+    Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < DISPATCH_BENCH_CALLS; i++)
+      table.CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+                               0, NULL, 0, NULL);
+    callTime += Clock::now() - start;
+
+    result = vkd.EndCommandBuffer(cmdBuffer);
+    assert(result == VK_SUCCESS);
+  }
+
+  commands.destroy();
+
+  fprintf(stdout, "%-28s %10.2f ns per call\n", label,
+          nanoseconds(callTime) / ((double)rounds * DISPATCH_BENCH_CALLS));
+}
+
+int main(int argc, char **argv) {
+  VulkanLoader::overrideDriver(getenv("VK_ICD_JSON"));
+  VulkanLoader::init(getenv("VK_LOADER_LIBRARY"));
+
+  const char *defaultSuites[] = {"pool", "dispatch"};
+  const char **suites = defaultSuites;
+  int suiteCount = sizeof(defaultSuites) / sizeof(defaultSuites[0]);
+
+  if (argc > 1) {
+    suites = (const char **)argv + 1;
+    suiteCount = argc - 1;
+  }
+
+  BenchDevice bench = createDevice();
+
+  for (int i = 0; i < suiteCount; i++) {
+    if (strcmp(suites[i], "pool") == 0) {
+      uint32_t rounds =
+          VulkanTools::getEnvUint("BENCH_ROUNDS", POOL_BENCH_ROUNDS);
+
+      if (rounds < 1) rounds = 1;
+
+      fprintf(stdout, "Command pool, %u buffers per reset:\n",
+              POOL_BENCH_BUFFERS);
+      benchPool(bench, "pool reset", false, rounds);
+      benchPool(bench, "per-buffer reset", true, rounds);
+    } else if (strcmp(suites[i], "dispatch") == 0) {
+      uint32_t rounds =
+          VulkanTools::getEnvUint("BENCH_ROUNDS", DISPATCH_BENCH_ROUNDS);
+
+      if (rounds < 1) rounds = 1;
+
+      fprintf(stdout, "vkCmdPipelineBarrier, %u calls per round:\n",
+              DISPATCH_BENCH_CALLS);
+      benchDispatch(bench, "device dispatch table", false, rounds);
+      benchDispatch(bench, "loader trampolines", true, rounds);
+    } else {
+      fprintf(stderr, "unknown suite: %s\n", suites[i]);
+      destroyDevice(bench);
+      return 2;
+    }
+  }
+
+  destroyDevice(bench);
+  return 0;
+}
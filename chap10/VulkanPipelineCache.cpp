@@ -0,0 +1,308 @@
+#include "VulkanPipelineCache.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanHostAllocator.hpp"
+#include "VulkanTools.hpp"
+
+#define CACHE_DIRECTORY_NAME "vulkan-example"
+
+// FNV-1a, only used to tell whether the driver's data changed.
+static uint64_t hashData(const uint8_t *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash ^ size;
+}
+
+static void defaultDirectory(char *directory, size_t size) {
+#if defined(_WIN32)
+  const char *base = getenv("LOCALAPPDATA");
+
+  if (base != NULL)
+    snprintf(directory, size, "%s\\%s", base, CACHE_DIRECTORY_NAME);
+  else
+    snprintf(directory, size, ".");
+#else
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  if (base != NULL && *base != '\0')
+    snprintf(directory, size, "%s/%s", base, CACHE_DIRECTORY_NAME);
+  else if (home != NULL)
+    snprintf(directory, size, "%s/.cache/%s", home, CACHE_DIRECTORY_NAME);
+  else
+    snprintf(directory, size, ".");
+#endif
+}
+
+// Creates `directory` and any missing parents.
+static void makeDirectories(const char *directory) {
+  char partial[PIPELINE_CACHE_PATH_MAX];
+  size_t length = strlen(directory);
+
+  if (length >= sizeof(partial)) return;
+
+  for (size_t i = 1; i <= length; i++) {
+    if (directory[i] != '/' && directory[i] != '\\' && directory[i] != '\0')
+      continue;
+
+    memcpy(partial, directory, i);
+    partial[i] = '\0';
+#if defined(_WIN32)
+    _mkdir(partial);
+#else
+    mkdir(partial, 0755);
+#endif
+  }
+}
+
+// Maps `path` read-only. Returns NULL if there is no usable file.
+static void *mapFile(const char *path, size_t *size) {
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+
+  LARGE_INTEGER fileSize;
+  void *data = NULL;
+
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+    HANDLE mapping =
+        CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (mapping != NULL) {
+      data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+  }
+
+  CloseHandle(file);
+  *size = data != NULL ? (size_t)fileSize.QuadPart : 0;
+  return data;
+#else
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  void *data = NULL;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) data = NULL;
+  }
+
+  close(fd);
+  *size = data != NULL ? (size_t)st.st_size : 0;
+  return data;
+#endif
+}
+
+static void unmapFile(void *data, size_t size) {
+#if defined(_WIN32)
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap(data, size);
+#endif
+}
+
+VulkanPipelineCache::VulkanPipelineCache()
+    : device(VK_NULL_HANDLE), cache(VK_NULL_HANDLE), savedHash(0) {
+  path[0] = '\0';
+}
+
+void VulkanPipelineCache::init(VkDevice device,
+                               const VkPhysicalDeviceProperties &properties,
+                               const char *directory, bool enabled) {
+  this->device = device;
+
+  if (!enabled) return;
+
+  char defaultDir[PIPELINE_CACHE_PATH_MAX];
+
+  if (directory == NULL || *directory == '\0') {
+    defaultDirectory(defaultDir, sizeof(defaultDir));
+    directory = defaultDir;
+  }
+
+  makeDirectories(directory);
+
+  char uuid[VK_UUID_SIZE * 2 + 1];
+
+  for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    snprintf(uuid + i * 2, 3, "%02x", properties.pipelineCacheUUID[i]);
+
+  snprintf(path, sizeof(path), "%s/pipeline-cache-%04x-%04x-%s.bin",
+           directory, properties.vendorID, properties.deviceID, uuid);
+
+  load(properties);
+}
+
+bool VulkanPipelineCache::validate(
+    const void *data, size_t size,
+    const VkPhysicalDeviceProperties &properties) {
+  const char *problem = NULL;
+  VkPipelineCacheHeaderVersionOne header;
+
+  if (size < sizeof(header)) {
+    problem = "truncated";
+  } else {
+    memcpy(&header, data, sizeof(header));
+
+    if (header.headerSize < sizeof(header) || header.headerSize > size)
+      problem = "bad header size";
+    else if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+      problem = "unknown header version";
+    else if (header.vendorID != properties.vendorID ||
+             header.deviceID != properties.deviceID)
+      problem = "written for another device";
+    else if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                    VK_UUID_SIZE) != 0)
+      problem = "written by another driver version";
+  }
+
+  if (problem != NULL)
+    fprintf(stderr, "Pipeline cache: ignoring %s (%s)\n", path, problem);
+
+  return problem == NULL;
+}
+
+void VulkanPipelineCache::load(const VkPhysicalDeviceProperties &properties) {
+  size_t size = 0;
+  void *data = mapFile(path, &size);
+  bool valid = data != NULL && validate(data, size, properties);
+
+  VkPipelineCacheCreateInfo cacheInfo = {};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.pNext = NULL;
+  cacheInfo.flags = 0;
+  cacheInfo.initialDataSize = valid ? size : 0;
+  cacheInfo.pInitialData = valid ? data : NULL;
+
+  VkResult result = vkd.CreatePipelineCache(
+      device, &cacheInfo, hostAllocator.callbacks(HOST_OBJECT_PIPELINE_CACHE),
+      &cache);
+
+  // The header can match while the rest of the blob is still unusable.
+  if (result != VK_SUCCESS && valid) {
+    fprintf(stderr, "Pipeline cache: driver rejected %s\n", path);
+    valid = false;
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData = NULL;
+    result = vkd.CreatePipelineCache(
+        device, &cacheInfo, hostAllocator.callbacks(HOST_OBJECT_PIPELINE_CACHE),
+        &cache);
+  }
+
+  if (result != VK_SUCCESS)
+    VulkanTools::exitOnError("Failed to create the pipeline cache");
+
+  if (valid)
+    fprintf(stdout, "Pipeline cache: %llu bytes from %s\n",
+            (unsigned long long)size, path);
+  else
+    fprintf(stdout, "Pipeline cache: starting empty, saving to %s\n", path);
+
+  if (data != NULL) unmapFile(data, size);
+
+  // Drivers serialize the cache in their own way, so the file bytes tell
+  // nothing about what a later save would produce. The baseline is what the
+  // driver reports right after loading.
+  std::vector<uint8_t> created;
+
+  if (getData(created)) savedHash = hashData(created.data(), created.size());
+}
+
+bool VulkanPipelineCache::getData(std::vector<uint8_t> &data) {
+  size_t size = 0;
+  VkResult result = vkd.GetPipelineCacheData(device, cache, &size, NULL);
+
+  if (result != VK_SUCCESS || size == 0) return false;
+
+  data.resize(size);
+  result = vkd.GetPipelineCacheData(device, cache, &size, data.data());
+  data.resize(size);
+  return result == VK_SUCCESS;
+}
+
+void VulkanPipelineCache::destroy() {
+  if (cache == VK_NULL_HANDLE) return;
+
+  save();
+  vkd.DestroyPipelineCache(device, cache,
+                           hostAllocator.callbacks(HOST_OBJECT_PIPELINE_CACHE));
+  cache = VK_NULL_HANDLE;
+}
+
+void VulkanPipelineCache::save() {
+  if (cache == VK_NULL_HANDLE) return;
+
+  std::vector<uint8_t> data;
+
+  if (!getData(data)) return;
+
+  size_t size = data.size();
+  uint64_t hash = hashData(data.data(), size);
+
+  if (hash == savedHash) return;
+
+  // The process ID keeps two instances from writing the same temp file.
+  char tempPath[PIPELINE_CACHE_PATH_MAX + 32];
+#if defined(_WIN32)
+  snprintf(tempPath, sizeof(tempPath), "%s.%d.tmp", path, _getpid());
+#else
+  snprintf(tempPath, sizeof(tempPath), "%s.%d.tmp", path, (int)getpid());
+#endif
+
+  FILE *file = fopen(tempPath, "wb");
+
+  if (file == NULL) {
+    fprintf(stderr, "Pipeline cache: cannot write %s: %s\n", tempPath,
+            strerror(errno));
+    return;
+  }
+
+  bool written = fwrite(data.data(), 1, size, file) == size &&
+                 fflush(file) == 0;
+#if !defined(_WIN32)
+  // The rename must not reach the disk before the data does.
+  written = written && fsync(fileno(file)) == 0;
+#endif
+  written = fclose(file) == 0 && written;
+
+#if defined(_WIN32)
+  bool renamed = written && MoveFileExA(tempPath, path,
+                                        MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  bool renamed = written && rename(tempPath, path) == 0;
+#endif
+
+  if (!renamed) {
+    fprintf(stderr, "Pipeline cache: failed to save %s\n", path);
+    remove(tempPath);
+    return;
+  }
+
+  savedHash = hash;
+}
@@ -0,0 +1,51 @@
+#ifndef VULKAN_PIPELINE_CACHE_HPP
+#define VULKAN_PIPELINE_CACHE_HPP
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#define PIPELINE_CACHE_PATH_MAX 1024
+
+// A VkPipelineCache that survives restarts. The file name carries the
+// vendor ID, device ID and pipelineCacheUUID, so every driver build gets
+// its own file, and the blob's header is checked against the device before
+// the driver sees it since some drivers do not cope with foreign data.
+// The file is mapped rather than read; the driver copies what it needs
+// while the cache is created and the mapping is dropped right after.
+//
+// Writes go to a temporary file that is renamed over the old one, so a
+// crash mid-save leaves the previous cache intact. Nothing is written when
+// the driver's data has not changed since the cache was created or last
+// saved. Saving is never done on a timer, since fetching and writing the
+// data can stall the thread that does it.
+class VulkanPipelineCache {
+ private:
+  VkDevice device;
+  VkPipelineCache cache;
+  char path[PIPELINE_CACHE_PATH_MAX];
+  uint64_t savedHash;
+
+  bool validate(const void *data, size_t size,
+                const VkPhysicalDeviceProperties &properties);
+  void load(const VkPhysicalDeviceProperties &properties);
+  bool getData(std::vector<uint8_t> &data);
+
+ public:
+  VulkanPipelineCache();
+
+  // `directory` may be NULL for the per-user cache directory. With
+  // `enabled` false handle() stays VK_NULL_HANDLE and nothing is saved.
+  void init(VkDevice device, const VkPhysicalDeviceProperties &properties,
+            const char *directory, bool enabled);
+
+  // Saves and destroys the cache.
+  void destroy();
+
+  // Writes the cache to disk if the driver has added anything. Meant for
+  // points where a stall is acceptable, such as after a loading screen.
+  void save();
+
+  VkPipelineCache handle() const { return cache; }
+};
+
+#endif  // VULKAN_PIPELINE_CACHE_HPP
@@ -0,0 +1,79 @@
+#include "VulkanStartupTimer.hpp"
+
+VulkanStartupTimer startupTimer;
+
+// Open phases on the calling thread, for nesting.
+static thread_local uint32_t openPhases = 0;
+
+static double toMs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+VulkanStartupTimer::VulkanStartupTimer()
+    : origin(std::chrono::steady_clock::now()),
+      total(std::chrono::steady_clock::duration::zero()),
+      phaseCount(0),
+      finished(false) {}
+
+uint32_t VulkanStartupTimer::begin(const char *name) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (finished || phaseCount == MAX_STARTUP_PHASES) return UINT32_MAX;
+
+  Phase &phase = phases[phaseCount];
+  phase.name = name;
+  phase.depth = openPhases++;
+  phase.start = now - origin;
+  phase.elapsed = std::chrono::steady_clock::duration::zero();
+  return phaseCount++;
+}
+
+void VulkanStartupTimer::end(uint32_t id) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  if (id == UINT32_MAX) return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  phases[id].elapsed = now - origin - phases[id].start;
+  openPhases--;
+}
+
+void VulkanStartupTimer::finish() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (finished) return;
+
+  total = std::chrono::steady_clock::now() - origin;
+  finished = true;
+}
+
+void VulkanStartupTimer::print(FILE *file) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  fprintf(file, "Startup: %.2f ms\n", toMs(total));
+  fprintf(file, "  %10s %10s  %s\n", "start ms", "took ms", "phase");
+
+  for (uint32_t i = 0; i < phaseCount; i++)
+    fprintf(file, "  %10.3f %10.3f  %*s%s\n", toMs(phases[i].start),
+            toMs(phases[i].elapsed), phases[i].depth * 2, "", phases[i].name);
+}
+
+void VulkanStartupTimer::printJson(FILE *file) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  fprintf(file, "{\n  \"total_ms\": %.3f,\n  \"phases\": [", toMs(total));
+
+  for (uint32_t i = 0; i < phaseCount; i++)
+    fprintf(file,
+            "%s\n    {\"name\": \"%s\", \"depth\": %u, \"start_ms\": %.3f, "
+            "\"duration_ms\": %.3f}",
+            i == 0 ? "" : ",", phases[i].name, phases[i].depth,
+            toMs(phases[i].start), toMs(phases[i].elapsed));
+
+  fprintf(file, "\n  ]\n}\n");
+}
+
+StartupPhase::StartupPhase(const char *name) : id(startupTimer.begin(name)) {}
+
+StartupPhase::~StartupPhase() { startupTimer.end(id); }
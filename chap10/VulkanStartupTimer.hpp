@@ -0,0 +1,58 @@
+#ifndef VULKAN_STARTUP_TIMER_HPP
+#define VULKAN_STARTUP_TIMER_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+
+#define MAX_STARTUP_PHASES 64
+
+// Records how long each step of startup takes on the monotonic clock.
+// Phases nest: one started while another is open on the same thread is
+// reported as part of it. Once finish() is called later phases are ignored,
+// so code shared with swapchain recreation can stay instrumented.
+class VulkanStartupTimer {
+ private:
+  struct Phase {
+    const char *name;
+    uint32_t depth;
+    std::chrono::steady_clock::duration start;
+    std::chrono::steady_clock::duration elapsed;
+  };
+
+  std::chrono::steady_clock::time_point origin;
+  std::chrono::steady_clock::duration total;
+  Phase phases[MAX_STARTUP_PHASES];
+  uint32_t phaseCount;
+  bool finished;
+  std::mutex mutex;
+
+ public:
+  VulkanStartupTimer();
+
+  // Returns an id for end(), or UINT32_MAX when nothing is being recorded.
+  uint32_t begin(const char *name);
+  void end(uint32_t id);
+
+  void finish();
+
+  void print(FILE *file);
+  void printJson(FILE *file);
+};
+
+// Times everything from construction to the end of the enclosing scope.
+class StartupPhase {
+ private:
+  uint32_t id;
+
+ public:
+  explicit StartupPhase(const char *name);
+  ~StartupPhase();
+};
+
+// Created during static initialization, so phase start times are measured
+// from roughly when the process started.
+extern VulkanStartupTimer startupTimer;
+
+#endif  // VULKAN_STARTUP_TIMER_HPP
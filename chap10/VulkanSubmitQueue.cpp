@@ -0,0 +1,198 @@
+#include "VulkanSubmitQueue.hpp"
+
+#include <cassert>
+
+VulkanSubmitQueue::VulkanSubmitQueue()
+    : queue(VK_NULL_HANDLE),
+      sync(NULL),
+      swapchain(NULL),
+      threaded(false),
+      pushed(0),
+      processed(0),
+      presented(0),
+      presentResult(VK_SUCCESS),
+      submitCalls(0),
+      sleeping(false),
+      stopping(false) {}
+
+void VulkanSubmitQueue::init(VkQueue queue, const VulkanSync *sync,
+                             VulkanSwapchain *swapchain, bool threaded) {
+  this->queue = queue;
+  this->sync = sync;
+  this->swapchain = swapchain;
+  this->threaded = threaded;
+
+  if (threaded) {
+    stopping = false;
+    submitThread = std::thread(&VulkanSubmitQueue::submitThreadMain, this);
+  }
+}
+
+void VulkanSubmitQueue::shutdown() {
+  if (!threaded) return;
+
+  waitIdle();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+
+  submitThread.join();
+  threaded = false;
+}
+
+void VulkanSubmitQueue::recordPresentResult(VkResult result) {
+  int32_t current = presentResult.load();
+
+  // Keep whichever result asks for more: an out of date swapchain must not
+  // be hidden by a later suboptimal one.
+  while (result != VK_SUCCESS && current != VK_ERROR_OUT_OF_DATE_KHR &&
+         !presentResult.compare_exchange_weak(current, result)) {
+  }
+}
+
+void VulkanSubmitQueue::push(const SubmitWork &item) {
+  pushed.fetch_add(1);
+
+  while (!work.push(item)) std::this_thread::yield();
+
+  // Pairs with the check in submitThreadMain(): either the thread sees the
+  // new item before it sleeps, or we see it asleep and wake it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (sleeping.load()) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_one();
+  }
+}
+
+void VulkanSubmitQueue::submit(const SubmitBatch &batch, VkFence fence) {
+  if (!threaded) {
+    submitCalls.fetch_add(1, std::memory_order_relaxed);
+    VkResult result = sync->submit(queue, &batch, 1, fence);
+    assert(result == VK_SUCCESS);
+    return;
+  }
+
+  SubmitWork item;
+  item.type = SUBMIT_WORK_BATCH;
+  item.batch = batch;
+  item.fence = fence;
+  push(item);
+}
+
+void VulkanSubmitQueue::present(uint32_t imageIndex,
+                                VkSemaphore waitSemaphore) {
+  assert(swapchain != NULL);
+
+  if (!threaded) {
+    recordPresentResult(
+        swapchain->swapchainPresent(queue, imageIndex, waitSemaphore));
+    presented.fetch_add(1, std::memory_order_release);
+    return;
+  }
+
+  SubmitWork item;
+  item.type = SUBMIT_WORK_PRESENT;
+  item.batch.reset();
+  item.fence = VK_NULL_HANDLE;
+  item.imageIndex = imageIndex;
+  item.semaphore = waitSemaphore;
+  push(item);
+}
+
+AcquireResult VulkanSubmitQueue::acquire(VkSemaphore signalSemaphore,
+                                         VkFence signalFence,
+                                         uint64_t timeout) {
+  assert(swapchain != NULL);
+
+  if (!threaded)
+    return swapchain->acquireNextImage(signalSemaphore, signalFence,
+                                       timeout);
+
+  // Presents still queued do not matter: the semaphore is signaled here,
+  // before the submission that waits on it is even handed to the driver.
+  std::lock_guard<std::mutex> lock(swapchainMutex);
+  return swapchain->acquireNextImage(signalSemaphore, signalFence, timeout);
+}
+
+void VulkanSubmitQueue::waitIdle() {
+  if (!threaded) return;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [&] { return processed.load() == pushed.load(); });
+}
+
+void VulkanSubmitQueue::submitThreadMain() {
+  SubmitBatch batches[MAX_SUBMIT_BATCHES];
+  uint32_t batchCount = 0;
+  uint64_t pending = 0;
+  SubmitWork item;
+
+  while (true) {
+    if (!work.pop(item)) {
+      // Nothing else is coming right now, so whatever has been gathered
+      // goes out without a fence.
+      if (batchCount > 0) {
+        VkResult result = sync->submit(queue, batches, batchCount,
+                                       VK_NULL_HANDLE);
+        assert(result == VK_SUCCESS);
+        submitCalls.fetch_add(1, std::memory_order_relaxed);
+        batchCount = 0;
+      }
+
+      if (pending > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        processed.fetch_add(pending);
+        pending = 0;
+        idle.notify_all();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      wake.wait(lock, [&] { return stopping || !work.empty(); });
+      sleeping.store(false);
+
+      if (stopping && work.empty()) return;
+
+      continue;
+    }
+
+    pending++;
+
+    if (item.type == SUBMIT_WORK_PRESENT) {
+      // Batches gathered so far go out first: the present is ordered after
+      // them.
+      if (batchCount > 0) {
+        VkResult result = sync->submit(queue, batches, batchCount,
+                                       VK_NULL_HANDLE);
+        assert(result == VK_SUCCESS);
+        submitCalls.fetch_add(1, std::memory_order_relaxed);
+        batchCount = 0;
+      }
+
+      std::unique_lock<std::mutex> lock(swapchainMutex);
+      VkResult result =
+          swapchain->swapchainPresent(queue, item.imageIndex, item.semaphore);
+      lock.unlock();
+
+      recordPresentResult(result);
+      presented.fetch_add(1, std::memory_order_release);
+      continue;
+    }
+
+    batches[batchCount++] = item.batch;
+
+    // The fence covers every batch in the same call, which is exactly what
+    // the producer asked for since batches are submitted in order.
+    if (item.fence != VK_NULL_HANDLE || batchCount == MAX_SUBMIT_BATCHES) {
+      VkResult result = sync->submit(queue, batches, batchCount, item.fence);
+      assert(result == VK_SUCCESS);
+      submitCalls.fetch_add(1, std::memory_order_relaxed);
+      batchCount = 0;
+    }
+  }
+}
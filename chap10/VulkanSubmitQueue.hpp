@@ -0,0 +1,169 @@
+#ifndef VULKAN_SUBMIT_QUEUE_HPP
+#define VULKAN_SUBMIT_QUEUE_HPP
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "VulkanSwapchain.hpp"
+#include "VulkanSync.hpp"
+
+#define SUBMIT_QUEUE_SIZE 64
+
+// Bounded multi-producer, single-consumer queue. Producers claim a cell with
+// one compare-and-swap on the tail and publish it through the cell's
+// sequence number, so pushing and popping take no lock. Waking a sleeping
+// consumer is up to the owner. Capacity must be a power of two.
+template <typename T, uint32_t Capacity>
+class MpscQueue {
+ private:
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    T item;
+  };
+
+  Cell cells[Capacity];
+  std::atomic<uint32_t> tail;
+  uint32_t head;
+
+ public:
+  MpscQueue() : tail(0), head(0) {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+    for (uint32_t i = 0; i < Capacity; i++)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool push(const T &item) {
+    uint32_t pos = tail.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+      cell = &cells[pos & (Capacity - 1)];
+      uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(seq - pos);
+
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->item = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only.
+  bool pop(T &item) {
+    Cell &cell = cells[head & (Capacity - 1)];
+    uint32_t seq = cell.sequence.load(std::memory_order_acquire);
+
+    if (seq != head + 1) return false;
+
+    item = cell.item;
+    cell.sequence.store(head + Capacity, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+  // Consumer only.
+  bool empty() const {
+    return cells[head & (Capacity - 1)].sequence.load(
+               std::memory_order_acquire) != head + 1;
+  }
+};
+
+enum SubmitWorkType { SUBMIT_WORK_BATCH, SUBMIT_WORK_PRESENT };
+
+struct SubmitWork {
+  SubmitWorkType type;
+  SubmitBatch batch;
+  VkFence fence;
+  uint32_t imageIndex;
+  // Waited on by a present.
+  VkSemaphore semaphore;
+};
+
+// Owns the VkQueue. Any thread can hand it batches; a dedicated thread turns
+// everything pending into as few vkQueueSubmit calls as possible, so driver
+// submission cost stays off the threads producing work. Batches are only
+// split where a fence or a present forces it, since a submit call takes a
+// single fence and presents are ordered against submissions.
+//
+// Acquires stay on the calling thread, so a producer never waits for the
+// work queued ahead of it. The swapchain is externally synchronized, so an
+// acquire only has to wait for a present that is in progress right now.
+//
+// Without the thread every call goes straight to the driver.
+class VulkanSubmitQueue {
+ private:
+  VkQueue queue;
+  const VulkanSync *sync;
+  VulkanSwapchain *swapchain;
+
+  bool threaded;
+  std::thread submitThread;
+  MpscQueue<SubmitWork, SUBMIT_QUEUE_SIZE> work;
+  std::atomic<uint64_t> pushed;
+  std::atomic<uint64_t> processed;
+  std::atomic<uint64_t> presented;
+  std::atomic<int32_t> presentResult;
+  std::atomic<uint64_t> submitCalls;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  // Held by the submission thread around each present.
+  std::mutex swapchainMutex;
+  std::atomic<bool> sleeping;
+  bool stopping;
+
+  void push(const SubmitWork &item);
+  void recordPresentResult(VkResult result);
+  void submitThreadMain();
+
+ public:
+  VulkanSubmitQueue();
+
+  void init(VkQueue queue, const VulkanSync *sync, VulkanSwapchain *swapchain,
+            bool threaded);
+  void shutdown();
+
+  bool isThreaded() const { return threaded; }
+
+  void submit(const SubmitBatch &batch, VkFence fence);
+  void present(uint32_t imageIndex, VkSemaphore waitSemaphore);
+
+  // Acquires the next swapchain image on the calling thread. See
+  // VulkanSwapchain::acquireNextImage().
+  AcquireResult acquire(VkSemaphore signalSemaphore, VkFence signalFence,
+                        uint64_t timeout);
+
+  // Blocks until everything queued so far has been handed to the driver.
+  // Required before recreating the swapchain from another thread.
+  void waitIdle();
+
+  // Number of presents that have been issued so far.
+  uint64_t presentCount() const {
+    return presented.load(std::memory_order_acquire);
+  }
+
+  // The most significant present result since the last call: out of date
+  // beats suboptimal beats success.
+  VkResult takePresentResult() {
+    return (VkResult)presentResult.exchange(VK_SUCCESS);
+  }
+
+  uint64_t takeSubmitCalls() { return submitCalls.exchange(0); }
+};
+
+#endif  // VULKAN_SUBMIT_QUEUE_HPP
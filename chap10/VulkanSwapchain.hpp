@@ -6,8 +6,11 @@
 #include <vulkan/vulkan.h>
 #include <cassert>
 #include <cstring>
-#include <vector>
 
+#include "VulkanBarrierBatch.hpp"
+#include "VulkanDeviceTable.hpp"
+#include "VulkanHostAllocator.hpp"
+#include "VulkanStartupTimer.hpp"
 #include "VulkanTools.hpp"
 
 #define GET_INSTANCE_PROC_ADDR(inst, entry)                              \
@@ -18,13 +21,14 @@
           "vkGetInstanceProcAddr failed to find vk" #entry);             \
   }
 
-#define GET_DEVICE_PROC_ADDR(dev, entry)                              \
-  {                                                                   \
-    fp##entry = (PFN_vk##entry)vkGetDeviceProcAddr(dev, "vk" #entry); \
-    if (!fp##entry)                                                   \
-      VulkanTools::exitOnError(                                       \
-          "vkGetDeviceProcAddr failed to find vk" #entry);            \
-  }
+// Surface queries and swapchain images live in fixed arrays, so creating
+// and recreating the swapchain does not touch the heap. Queries that find
+// more entries than fit only see the first ones.
+#define MAX_QUEUE_FAMILIES 16
+#define MAX_SURFACE_FORMATS 64
+#define MAX_PRESENT_MODES 16
+#define MAX_SWAPCHAIN_IMAGES 16
+#define MAX_RETIRED_SWAPCHAINS 8
 
 struct SwapChainBuffer {
   VkImage image;
@@ -32,6 +36,47 @@ struct SwapChainBuffer {
   VkFramebuffer frameBuffer;
 };
 
+enum PresentProfile {
+  PRESENT_PROFILE_DEFAULT,
+  PRESENT_PROFILE_LOW_LATENCY,
+  PRESENT_PROFILE_THROUGHPUT,
+  PRESENT_PROFILE_POWER,
+  PRESENT_PROFILE_COUNT
+};
+
+// Present modes in order of preference and the number of images to request
+// on top of the surface's minimum.
+struct PresentPolicy {
+  const char *name;
+  VkPresentModeKHR modes[2];
+  uint32_t modeCount;
+  uint32_t extraImages;
+};
+
+static const PresentPolicy presentPolicies[PRESENT_PROFILE_COUNT] = {
+    {"default",
+     {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR},
+     2,
+     1},
+    {"low-latency",
+     {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR},
+     2,
+     0},
+    {"throughput", {VK_PRESENT_MODE_FIFO_RELAXED_KHR}, 1, 2},
+    {"power", {VK_PRESENT_MODE_FIFO_KHR}, 1, 0}};
+
+struct AcquireResult {
+  VkResult result;
+  uint32_t imageIndex;
+};
+
+struct RetiredSwapchain {
+  VkSwapchainKHR swapchain;
+  SwapChainBuffer buffers[MAX_SWAPCHAIN_IMAGES];
+  uint32_t bufferCount;
+  uint64_t retireFrame;
+};
+
 class VulkanSwapchain {
 private:
   VkInstance instance;
@@ -46,11 +91,10 @@ private:
   PFN_vkGetPhysicalDeviceSurfacePresentModesKHR
     fpGetPhysicalDeviceSurfacePresentModesKHR;
 
-  PFN_vkCreateSwapchainKHR fpCreateSwapchainKHR;
-  PFN_vkDestroySwapchainKHR fpDestroySwapchainKHR;
-  PFN_vkGetSwapchainImagesKHR fpGetSwapchainImagesKHR;
-  PFN_vkAcquireNextImageKHR fpAcquireNextImageKHR;
-  PFN_vkQueuePresentKHR fpQueuePresentKHR;
+  RetiredSwapchain retired[MAX_RETIRED_SWAPCHAINS];
+  uint32_t retiredCount;
+  PresentProfile presentProfile;
+  uint32_t preferredQueueIndex;
 
 public:
   VkSwapchainKHR swapchain;
@@ -60,25 +104,58 @@ public:
 
   VkFormat colorFormat;
   VkColorSpaceKHR colorSpace;
+  VkExtent2D extent;
+  VkPresentModeKHR presentMode;
+
+  SwapChainBuffer buffers[MAX_SWAPCHAIN_IMAGES];
+
+  VulkanSwapchain()
+      : retiredCount(0),
+        presentProfile(PRESENT_PROFILE_DEFAULT),
+        preferredQueueIndex(UINT32_MAX),
+        imageCount(0) {}
+
+  static PresentProfile parsePresentProfile(const char *name) {
+    if (name == NULL || *name == '\0') return PRESENT_PROFILE_DEFAULT;
+
+    for (uint32_t i = 0; i < PRESENT_PROFILE_COUNT; i++)
+      if (strcmp(name, presentPolicies[i].name) == 0) return (PresentProfile)i;
+
+    fprintf(stderr, "Unknown present profile \"%s\", using default\n", name);
+    return PRESENT_PROFILE_DEFAULT;
+  }
+
+  static const char *presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+      case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "IMMEDIATE";
+      case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "MAILBOX";
+      case VK_PRESENT_MODE_FIFO_KHR:
+        return "FIFO";
+      case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "FIFO_RELAXED";
+      default:
+        return "UNKNOWN";
+    }
+  }
 
-  std::vector<VkImage> images;
-  std::vector<SwapChainBuffer> buffers;
+  // Takes effect the next time the swapchain is created or recreated.
+  void setPresentProfile(PresentProfile profile) { presentProfile = profile; }
 
+  // `preferredQueueIndex` is the family the device's graphics queue was
+  // created from; createSurface() picks it whenever it can present.
   void init(VkInstance instance, VkPhysicalDevice physicalDevice,
-            VkDevice device) {
+            VkDevice device, uint32_t preferredQueueIndex = UINT32_MAX) {
     this->instance = instance;
     this->physicalDevice = physicalDevice;
     this->device = device;
+    this->preferredQueueIndex = preferredQueueIndex;
 
     GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceSupportKHR);
     GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceCapabilitiesKHR);
     GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceFormatsKHR);
     GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfacePresentModesKHR);
-    GET_DEVICE_PROC_ADDR(device, CreateSwapchainKHR);
-    GET_DEVICE_PROC_ADDR(device, DestroySwapchainKHR);
-    GET_DEVICE_PROC_ADDR(device, GetSwapchainImagesKHR);
-    GET_DEVICE_PROC_ADDR(device, AcquireNextImageKHR);
-    GET_DEVICE_PROC_ADDR(device, QueuePresentKHR);
   }
 
   void createSurface(
@@ -88,6 +165,8 @@ public:
       xcb_connection_t *connection, xcb_window_t window
 #endif
       ) {
+    uint32_t phase = startupTimer.begin("surface creation");
+
 #if defined(_WIN32)
     VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = {};
     surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
@@ -96,7 +175,9 @@ public:
     surfaceCreateInfo.hinstance = windowInstance;
     surfaceCreateInfo.hwnd = window;
     VkResult result =
-        vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo, NULL, &surface);
+        vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo,
+                                hostAllocator.callbacks(HOST_OBJECT_SURFACE),
+                                &surface);
 #elif defined(__linux__)
     VkXcbSurfaceCreateInfoKHR surfaceCreateInfo = {};
     surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
@@ -105,28 +186,38 @@ public:
     surfaceCreateInfo.connection = connection;
     surfaceCreateInfo.window = window;
     VkResult result =
-        vkCreateXcbSurfaceKHR(instance, &surfaceCreateInfo, NULL, &surface);
+        vkCreateXcbSurfaceKHR(instance, &surfaceCreateInfo,
+                              hostAllocator.callbacks(HOST_OBJECT_SURFACE),
+                              &surface);
 #endif
 
     assert(result == VK_SUCCESS);
+    startupTimer.end(phase);
 
-    uint32_t queueCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, NULL);
+    phase = startupTimer.begin("present support query");
+    VkQueueFamilyProperties queueProperties[MAX_QUEUE_FAMILIES];
+    uint32_t queueCount = MAX_QUEUE_FAMILIES;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount,
+                                             queueProperties);
 
     assert(queueCount >= 1);
 
-    std::vector<VkQueueFamilyProperties> queueProperties(queueCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount,
-                                             queueProperties.data());
-
     queueIndex = UINT32_MAX;
-    std::vector<VkBool32> supportsPresenting(queueCount);
 
-    for (uint32_t i = 0; i < queueCount; i++) {
+    if (preferredQueueIndex < queueCount) {
+      VkBool32 supported = VK_FALSE;
+      fpGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, preferredQueueIndex,
+                                           surface, &supported);
+
+      if (supported == VK_TRUE) queueIndex = preferredQueueIndex;
+    }
+
+    for (uint32_t i = 0; i < queueCount && queueIndex == UINT32_MAX; i++) {
+      VkBool32 supportsPresenting = VK_FALSE;
       fpGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface,
-                                           &supportsPresenting[i]);
+                                           &supportsPresenting);
       if ((queueProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
-        if (supportsPresenting[i] == VK_TRUE) {
+        if (supportsPresenting == VK_TRUE) {
           queueIndex = i;
           break;
         }
@@ -134,18 +225,16 @@ public:
     }
 
     assert(queueIndex != UINT32_MAX);
+    startupTimer.end(phase);
 
-    uint32_t formatCount = 0;
+    phase = startupTimer.begin("surface format query");
+    VkSurfaceFormatKHR surfaceFormats[MAX_SURFACE_FORMATS];
+    uint32_t formatCount = MAX_SURFACE_FORMATS;
     result = fpGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface,
-                                                  &formatCount, NULL);
-
-    assert(result == VK_SUCCESS && formatCount >= 1);
-
-    std::vector<VkSurfaceFormatKHR> surfaceFormats(formatCount);
-    result = fpGetPhysicalDeviceSurfaceFormatsKHR(
-        physicalDevice, surface, &formatCount, surfaceFormats.data());
+                                                  &formatCount, surfaceFormats);
 
-    assert(result == VK_SUCCESS);
+    assert((result == VK_SUCCESS || result == VK_INCOMPLETE) &&
+           formatCount >= 1);
 
     if (formatCount == 1 && surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
       colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
@@ -153,9 +242,12 @@ public:
       colorFormat = surfaceFormats[0].format;
 
     colorSpace = surfaceFormats[0].colorSpace;
+    startupTimer.end(phase);
   }
 
-  void create(VkCommandBuffer cmdBuffer) {
+private:
+  bool build(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain) {
+    uint32_t phase = startupTimer.begin("surface capabilities query");
     VkSurfaceCapabilitiesKHR caps = {};
     VkResult result = fpGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice,
                                                                 surface, &caps);
@@ -166,43 +258,52 @@ public:
 
     VkExtent2D swapchainExtent = {};
 
-    if (caps.currentExtent.width == -1 || caps.currentExtent.height == -1) {
-      swapchainExtent.width = WINDOW_WIDTH;
-      swapchainExtent.height = WINDOW_HEIGHT;
+    if (caps.currentExtent.width == 0xFFFFFFFF ||
+        caps.currentExtent.height == 0xFFFFFFFF) {
+      swapchainExtent.width = width;
+      swapchainExtent.height = height;
     } else {
       swapchainExtent = caps.currentExtent;
     }
 
-    uint32_t presentModeCount = 0;
-    result = fpGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface,
-                                                       &presentModeCount, NULL);
+    startupTimer.end(phase);
 
-    assert(result == VK_SUCCESS);
-    assert(presentModeCount >= 1);
+    // A minimized window has no area to present to; keep the current
+    // swapchain until it becomes visible again.
+    if (swapchainExtent.width == 0 || swapchainExtent.height == 0) return false;
 
-    std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+    phase = startupTimer.begin("present mode query");
+    VkPresentModeKHR presentModes[MAX_PRESENT_MODES];
+    uint32_t presentModeCount = MAX_PRESENT_MODES;
     result = fpGetPhysicalDeviceSurfacePresentModesKHR(
-        physicalDevice, surface, &presentModeCount, presentModes.data());
+        physicalDevice, surface, &presentModeCount, presentModes);
 
-    assert(result == VK_SUCCESS);
+    assert(result == VK_SUCCESS || result == VK_INCOMPLETE);
+    assert(presentModeCount >= 1);
+    startupTimer.end(phase);
 
+    const PresentPolicy &policy = presentPolicies[presentProfile];
+
+    // FIFO is the only mode every surface must support, so it is the final
+    // fallback for every profile.
     VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    bool found = false;
 
-    for (uint32_t i = 0; i < presentModeCount; i++) {
-      if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-        presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-        break;
+    for (uint32_t p = 0; p < policy.modeCount && !found; p++) {
+      for (uint32_t i = 0; i < presentModeCount; i++) {
+        if (presentModes[i] == policy.modes[p]) {
+          presentMode = policy.modes[p];
+          found = true;
+          break;
+        }
       }
-
-      if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR)
-        presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
     }
 
-    assert(caps.maxImageCount >= 1);
-
-    uint32_t imageCount = caps.minImageCount + 1;
+    uint32_t imageCount = caps.minImageCount + policy.extraImages;
 
-    if (imageCount > caps.maxImageCount) imageCount = caps.maxImageCount;
+    // A maxImageCount of zero means the surface has no upper limit.
+    if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount)
+      imageCount = caps.maxImageCount;
 
     VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
     swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -213,28 +314,34 @@ public:
     swapchainCreateInfo.imageExtent = {swapchainExtent.width,
                                        swapchainExtent.height};
     swapchainCreateInfo.imageArrayLayers = 1;
-    swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchainCreateInfo.imageUsage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchainCreateInfo.queueFamilyIndexCount = 1;
     swapchainCreateInfo.pQueueFamilyIndices = {0};
     swapchainCreateInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchainCreateInfo.presentMode = presentMode;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
-    result =
-        fpCreateSwapchainKHR(device, &swapchainCreateInfo, NULL, &swapchain);
+    phase = startupTimer.begin("vkCreateSwapchainKHR");
+    result = vkd.CreateSwapchainKHR(
+        device, &swapchainCreateInfo,
+        hostAllocator.callbacks(HOST_OBJECT_SWAPCHAIN), &swapchain);
 
     assert(result == VK_SUCCESS);
+    startupTimer.end(phase);
 
-    result = fpGetSwapchainImagesKHR(device, swapchain, &imageCount, NULL);
+    phase = startupTimer.begin("swapchain images and views");
+    result = vkd.GetSwapchainImagesKHR(device, swapchain, &imageCount, NULL);
 
     assert(result == VK_SUCCESS);
 
-    images.resize(imageCount);
-    buffers.resize(imageCount);
+    if (imageCount > MAX_SWAPCHAIN_IMAGES)
+      VulkanTools::exitOnError("The swapchain has too many images");
 
-    result =
-        fpGetSwapchainImagesKHR(device, swapchain, &imageCount, images.data());
+    VkImage images[MAX_SWAPCHAIN_IMAGES];
+    result = vkd.GetSwapchainImagesKHR(device, swapchain, &imageCount, images);
 
     assert(result == VK_SUCCESS);
 
@@ -255,12 +362,10 @@ public:
       imageCreateInfo.flags = 0;
 
       buffers[i].image = images[i];
-      VulkanTools::setImageLayout(
-          cmdBuffer, buffers[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
-          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
       imageCreateInfo.image = buffers[i].image;
-      result =
-          vkCreateImageView(device, &imageCreateInfo, NULL, &buffers[i].view);
+      result = vkd.CreateImageView(
+          device, &imageCreateInfo,
+          hostAllocator.callbacks(HOST_OBJECT_IMAGE_VIEW), &buffers[i].view);
 
       assert(result == VK_SUCCESS);
 
@@ -272,34 +377,148 @@ public:
       fbCreateInfo.height = swapchainExtent.height;
       fbCreateInfo.layers = 1;
 
-      result = vkCreateFramebuffer(device, &fbCreateInfo, NULL,
-                                   &buffers[i].frameBuffer);
+      result = vkd.CreateFramebuffer(
+          device, &fbCreateInfo,
+          hostAllocator.callbacks(HOST_OBJECT_FRAMEBUFFER),
+          &buffers[i].frameBuffer);
 
       assert(result == VK_SUCCESS);
     }
+
+    startupTimer.end(phase);
+
+    fprintf(stdout, "Present profile: %s, mode: %s, images: %u (%ux%u)\n",
+            policy.name, presentModeName(presentMode), imageCount,
+            swapchainExtent.width, swapchainExtent.height);
+
+    this->imageCount = imageCount;
+    this->presentMode = presentMode;
+    extent = swapchainExtent;
+    return true;
   }
 
-  void getSwapchainNext(VkSemaphore presentCompleteSemaphore, uint32_t buffer) {
-    VkResult result =
-        fpAcquireNextImageKHR(device, swapchain, UINT64_MAX,
-                              presentCompleteSemaphore, (VkFence)0, &buffer);
+  void destroyBuffers(VkSwapchainKHR retiredSwapchain,
+                      const SwapChainBuffer *retiredBuffers,
+                      uint32_t bufferCount) {
+    for (uint32_t i = 0; i < bufferCount; i++) {
+      vkd.DestroyFramebuffer(device, retiredBuffers[i].frameBuffer,
+                             hostAllocator.callbacks(HOST_OBJECT_FRAMEBUFFER));
+      vkd.DestroyImageView(device, retiredBuffers[i].view,
+                           hostAllocator.callbacks(HOST_OBJECT_IMAGE_VIEW));
+    }
 
-    if (result != VK_SUCCESS)
-      VulkanTools::exitOnError("Failed to get next image in swapchain");
+    vkd.DestroySwapchainKHR(device, retiredSwapchain,
+                            hostAllocator.callbacks(HOST_OBJECT_SWAPCHAIN));
   }
 
-  void swapchainPresent(VkCommandBuffer cmdBuffer, VkQueue queue,
-                        uint32_t buffer) {
+public:
+  void create(VkCommandBuffer cmdBuffer) {
+    if (!build(WINDOW_WIDTH, WINDOW_HEIGHT, VK_NULL_HANDLE))
+      VulkanTools::exitOnError("Failed to create swapchain");
+
+    VulkanBarrierBatch barriers;
+
+    for (uint32_t i = 0; i < imageCount; i++)
+      barriers.addImageLayout(buffers[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    barriers.flush(cmdBuffer);
+  }
+
+  // Builds a new swapchain from the current one without waiting for the
+  // device. The old swapchain, image views and framebuffers may still be
+  // referenced by frames in flight, so they are kept until releaseRetired()
+  // is told that every frame before frameNumber has completed.
+  //
+  // Acquires from and presents to the current swapchain must have left the
+  // submission thread.
+  bool recreate(uint32_t width, uint32_t height, uint64_t frameNumber) {
+    // Only a resize storm outpacing the frames in flight gets here, so
+    // waiting for the device is cheaper than making room.
+    if (retiredCount == MAX_RETIRED_SWAPCHAINS) {
+      vkd.DeviceWaitIdle(device);
+      releaseRetired(UINT64_MAX);
+    }
+
+    RetiredSwapchain &old = retired[retiredCount];
+    old.swapchain = swapchain;
+    old.bufferCount = imageCount;
+    old.retireFrame = frameNumber;
+    memcpy(old.buffers, buffers, sizeof(buffers));
+
+    if (!build(width, height, old.swapchain)) return false;
+
+    retiredCount++;
+    return true;
+  }
+
+  void releaseRetired(uint64_t completedFrames) {
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < retiredCount; i++) {
+      if (retired[i].retireFrame <= completedFrames)
+        destroyBuffers(retired[i].swapchain, retired[i].buffers,
+                       retired[i].bufferCount);
+      else
+        retired[kept++] = retired[i];
+    }
+
+    retiredCount = kept;
+  }
+
+  void destroy() {
+    releaseRetired(UINT64_MAX);
+    destroyBuffers(swapchain, buffers, imageCount);
+    imageCount = 0;
+    swapchain = VK_NULL_HANDLE;
+  }
+
+  // The swapchain and everything retired must be destroyed first.
+  void destroySurface() {
+    vkDestroySurfaceKHR(instance, surface,
+                        hostAllocator.callbacks(HOST_OBJECT_SURFACE));
+    surface = VK_NULL_HANDLE;
+  }
+
+  // Acquires the next presentable image. The index is only valid when the
+  // result is VK_SUCCESS or VK_SUBOPTIMAL_KHR. VK_NOT_READY (zero timeout),
+  // VK_TIMEOUT and VK_ERROR_OUT_OF_DATE_KHR are returned to the caller
+  // rather than treated as fatal, as are device and surface loss.
+  AcquireResult acquireNextImage(VkSemaphore semaphore,
+                                 VkFence fence = VK_NULL_HANDLE,
+                                 uint64_t timeout = UINT64_MAX) {
+    AcquireResult acquired = {};
+    acquired.imageIndex = UINT32_MAX;
+    acquired.result = vkd.AcquireNextImageKHR(device, swapchain, timeout,
+                                              semaphore, fence,
+                                              &acquired.imageIndex);
+    return acquired;
+  }
+
+  AcquireResult tryAcquireNextImage(VkSemaphore semaphore,
+                                    VkFence fence = VK_NULL_HANDLE) {
+    return acquireNextImage(semaphore, fence, 0);
+  }
+
+  VkResult swapchainPresent(VkQueue queue, uint32_t buffer,
+                            VkSemaphore renderCompleteSemaphore) {
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.pNext = NULL;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &renderCompleteSemaphore;
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapchain;
     presentInfo.pImageIndices = &buffer;
 
-    VkResult result = fpQueuePresentKHR(queue, &presentInfo);
+    VkResult result = vkd.QueuePresentKHR(queue, &presentInfo);
 
-    assert(result == VK_SUCCESS);
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR &&
+        result != VK_ERROR_OUT_OF_DATE_KHR)
+      VulkanTools::exitOnError("Failed to present swapchain image");
+
+    return result;
   }
 };
 
@@ -0,0 +1,148 @@
+#include "VulkanSync.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanTools.hpp"
+
+void SubmitBatch::reset() {
+  waitCount = 0;
+  commandBufferCount = 0;
+  signalCount = 0;
+}
+
+void SubmitBatch::addWait(VkSemaphore semaphore, VkPipelineStageFlags stages) {
+  assert(waitCount < MAX_SUBMIT_SEMAPHORES);
+  waitSemaphores[waitCount] = semaphore;
+  waitStages[waitCount] = stages;
+  waitCount++;
+}
+
+void SubmitBatch::addCommandBuffer(VkCommandBuffer cmdBuffer) {
+  assert(commandBufferCount < MAX_SUBMIT_COMMAND_BUFFERS);
+  commandBuffers[commandBufferCount++] = cmdBuffer;
+}
+
+void SubmitBatch::addSignal(VkSemaphore semaphore) {
+  assert(signalCount < MAX_SUBMIT_SEMAPHORES);
+  signalSemaphores[signalCount++] = semaphore;
+}
+
+VulkanSync::VulkanSync() : sync2(false) {}
+
+bool VulkanSync::isSupported(VkInstance instance,
+                             VkPhysicalDevice physicalDevice) {
+#if defined(VK_KHR_synchronization2)
+  if (!VulkanTools::hasDeviceExtension(physicalDevice,
+                                       VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+    return false;
+
+  // The extension can be exposed without the feature being usable, so the
+  // feature bit has to be queried as well. That needs
+  // VK_KHR_get_physical_device_properties2 on a Vulkan 1.0 instance.
+  PFN_vkGetPhysicalDeviceFeatures2KHR fpGetPhysicalDeviceFeatures2KHR =
+      (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+          instance, "vkGetPhysicalDeviceFeatures2KHR");
+
+  if (!fpGetPhysicalDeviceFeatures2KHR) return false;
+
+  VkPhysicalDeviceSynchronization2FeaturesKHR sync2Features = {};
+  sync2Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+
+  VkPhysicalDeviceFeatures2KHR features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+  features.pNext = &sync2Features;
+  fpGetPhysicalDeviceFeatures2KHR(physicalDevice, &features);
+
+  return sync2Features.synchronization2 == VK_TRUE;
+#else
+  return false;
+#endif
+}
+
+void VulkanSync::init(bool enabled) {
+  sync2 = false;
+
+#if defined(VK_KHR_synchronization2)
+  sync2 = enabled && vkd.CmdPipelineBarrier2KHR != NULL &&
+          vkd.QueueSubmit2KHR != NULL;
+#endif
+}
+
+VkResult VulkanSync::submit(VkQueue queue, const SubmitBatch *batches,
+                            uint32_t batchCount, VkFence fence) const {
+  assert(batchCount <= MAX_SUBMIT_BATCHES);
+
+#if defined(VK_KHR_synchronization2)
+  if (sync2) {
+    VkSubmitInfo2KHR submitInfos[MAX_SUBMIT_BATCHES];
+    VkSemaphoreSubmitInfoKHR waitInfos[MAX_SUBMIT_BATCHES]
+                                      [MAX_SUBMIT_SEMAPHORES];
+    VkSemaphoreSubmitInfoKHR signalInfos[MAX_SUBMIT_BATCHES]
+                                        [MAX_SUBMIT_SEMAPHORES];
+    VkCommandBufferSubmitInfoKHR cmdInfos[MAX_SUBMIT_BATCHES]
+                                         [MAX_SUBMIT_COMMAND_BUFFERS];
+
+    for (uint32_t b = 0; b < batchCount; b++) {
+      const SubmitBatch &batch = batches[b];
+
+      for (uint32_t i = 0; i < batch.waitCount; i++) {
+        VkSemaphoreSubmitInfoKHR &info = waitInfos[b][i];
+        memset(&info, 0, sizeof(info));
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+        info.semaphore = batch.waitSemaphores[i];
+        info.stageMask = batch.waitStages[i];
+      }
+
+      // Signalling only after the whole batch keeps the 1.0 semantics.
+      for (uint32_t i = 0; i < batch.signalCount; i++) {
+        VkSemaphoreSubmitInfoKHR &info = signalInfos[b][i];
+        memset(&info, 0, sizeof(info));
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+        info.semaphore = batch.signalSemaphores[i];
+        info.stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+      }
+
+      for (uint32_t i = 0; i < batch.commandBufferCount; i++) {
+        VkCommandBufferSubmitInfoKHR &info = cmdInfos[b][i];
+        memset(&info, 0, sizeof(info));
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+        info.commandBuffer = batch.commandBuffers[i];
+      }
+
+      VkSubmitInfo2KHR &submitInfo = submitInfos[b];
+      memset(&submitInfo, 0, sizeof(submitInfo));
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+      submitInfo.waitSemaphoreInfoCount = batch.waitCount;
+      submitInfo.pWaitSemaphoreInfos = waitInfos[b];
+      submitInfo.commandBufferInfoCount = batch.commandBufferCount;
+      submitInfo.pCommandBufferInfos = cmdInfos[b];
+      submitInfo.signalSemaphoreInfoCount = batch.signalCount;
+      submitInfo.pSignalSemaphoreInfos = signalInfos[b];
+    }
+
+    return vkd.QueueSubmit2KHR(queue, batchCount, submitInfos, fence);
+  }
+#endif
+
+  VkSubmitInfo submitInfos[MAX_SUBMIT_BATCHES];
+
+  for (uint32_t b = 0; b < batchCount; b++) {
+    const SubmitBatch &batch = batches[b];
+    VkSubmitInfo &submitInfo = submitInfos[b];
+    memset(&submitInfo, 0, sizeof(submitInfo));
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = NULL;
+    submitInfo.waitSemaphoreCount = batch.waitCount;
+    submitInfo.pWaitSemaphores = batch.waitSemaphores;
+    submitInfo.pWaitDstStageMask = batch.waitStages;
+    submitInfo.commandBufferCount = batch.commandBufferCount;
+    submitInfo.pCommandBuffers = batch.commandBuffers;
+    submitInfo.signalSemaphoreCount = batch.signalCount;
+    submitInfo.pSignalSemaphores = batch.signalSemaphores;
+  }
+
+  return vkd.QueueSubmit(queue, batchCount, submitInfos, fence);
+}
@@ -0,0 +1,61 @@
+#ifndef VULKAN_SYNC_HPP
+#define VULKAN_SYNC_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanDeviceTable.hpp"
+
+#define MAX_SUBMIT_SEMAPHORES 4
+#define MAX_SUBMIT_COMMAND_BUFFERS 8
+#define MAX_SUBMIT_BATCHES 16
+
+// One VkSubmitInfo worth of work, stored inline so it can be built on the
+// stack and copied around without allocating.
+struct SubmitBatch {
+  uint32_t waitCount;
+  VkSemaphore waitSemaphores[MAX_SUBMIT_SEMAPHORES];
+  VkPipelineStageFlags waitStages[MAX_SUBMIT_SEMAPHORES];
+  uint32_t commandBufferCount;
+  VkCommandBuffer commandBuffers[MAX_SUBMIT_COMMAND_BUFFERS];
+  uint32_t signalCount;
+  VkSemaphore signalSemaphores[MAX_SUBMIT_SEMAPHORES];
+
+  void reset();
+  void addWait(VkSemaphore semaphore, VkPipelineStageFlags stages);
+  void addCommandBuffer(VkCommandBuffer cmdBuffer);
+  void addSignal(VkSemaphore semaphore);
+};
+
+// Chooses between the Vulkan 1.0 barrier and submission entry points and
+// their VK_KHR_synchronization2 counterparts. The latter carry stage masks
+// per barrier and per semaphore, which lets drivers overlap more work.
+class VulkanSync {
+ private:
+  bool sync2;
+
+ public:
+  VulkanSync();
+
+  // Whether the device supports synchronization2. Must be checked before
+  // vkCreateDevice so the extension and feature can be enabled.
+  static bool isSupported(VkInstance instance,
+                          VkPhysicalDevice physicalDevice);
+
+  // `enabled` says whether the extension and feature were enabled on the
+  // device; without them every call takes the Vulkan 1.0 path. vkd must
+  // already be loaded.
+  void init(bool enabled);
+  bool usingSync2() const { return sync2; }
+
+  VkResult submit(VkQueue queue, const SubmitBatch *batches,
+                  uint32_t batchCount, VkFence fence) const;
+
+#if defined(VK_KHR_synchronization2)
+  void pipelineBarrier2(VkCommandBuffer cmdBuffer,
+                        const VkDependencyInfoKHR &dependencyInfo) const {
+    vkd.CmdPipelineBarrier2KHR(cmdBuffer, &dependencyInfo);
+  }
+#endif
+};
+
+#endif  // VULKAN_SYNC_HPP
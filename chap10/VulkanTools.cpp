@@ -1,5 +1,12 @@
 #include "VulkanTools.hpp"
 
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "VulkanDeviceTable.hpp"
+
 void VulkanTools::exitOnError(const char *msg) {
 #if defined(_WIN32)
   MessageBox(NULL, msg, ENGINE_NAME, MB_ICONERROR);
@@ -10,13 +17,203 @@ void VulkanTools::exitOnError(const char *msg) {
   exit(EXIT_FAILURE);
 }
 
-void VulkanTools::setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
-                                 VkImageAspectFlags aspects,
-                                 VkImageLayout oldLayout,
-                                 VkImageLayout newLayout) {
+uint32_t VulkanTools::getEnvUint(const char *name, uint32_t defaultValue) {
+  const char *value = getenv(name);
+
+  if (value == NULL || *value == '\0') return defaultValue;
+
+  // strtoul would take "-1" and hand back its negation, so only digits are
+  // accepted, and only values that fit.
+  if (*value < '0' || *value > '9') return defaultValue;
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long parsed = strtoul(value, &end, 10);
+
+  if (*end != '\0' || errno == ERANGE || parsed > UINT32_MAX)
+    return defaultValue;
+
+  return (uint32_t)parsed;
+}
+
+bool VulkanTools::hasInstanceExtension(const char *name) {
+  uint32_t count = 0;
+  VkResult result = vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+
+  if (result != VK_SUCCESS) return false;
+
+  std::vector<VkExtensionProperties> extensions(count);
+  result =
+      vkEnumerateInstanceExtensionProperties(NULL, &count, extensions.data());
+
+  if (result != VK_SUCCESS) return false;
+
+  for (uint32_t i = 0; i < count; i++)
+    if (strcmp(extensions[i].extensionName, name) == 0) return true;
+
+  return false;
+}
+
+bool VulkanTools::hasDeviceExtension(VkPhysicalDevice physicalDevice,
+                                     const char *name) {
+  uint32_t count = 0;
+  VkResult result =
+      vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count, NULL);
+
+  if (result != VK_SUCCESS) return false;
+
+  std::vector<VkExtensionProperties> extensions(count);
+  result = vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &count,
+                                                extensions.data());
+
+  if (result != VK_SUCCESS) return false;
+
+  for (uint32_t i = 0; i < count; i++)
+    if (strcmp(extensions[i].extensionName, name) == 0) return true;
+
+  return false;
+}
+
+VulkanTools::QueueFamilies VulkanTools::findQueueFamilies(
+    VkPhysicalDevice physicalDevice) {
+  uint32_t count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, NULL);
+  assert(count >= 1);
+
+  std::vector<VkQueueFamilyProperties> properties(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count,
+                                           properties.data());
+
+  QueueFamilies families = {UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+  for (uint32_t i = 0; i < count; i++) {
+    VkQueueFlags flags = properties[i].queueFlags;
+
+    if (properties[i].queueCount == 0) continue;
+
+    if ((flags & VK_QUEUE_GRAPHICS_BIT) && families.graphics == UINT32_MAX)
+      families.graphics = i;
+
+    // Async compute: a compute family that is not also the graphics one.
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+        families.compute == UINT32_MAX)
+      families.compute = i;
+
+    // A transfer-only family is usually a dedicated copy engine.
+    if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+        families.transfer == UINT32_MAX)
+      families.transfer = i;
+  }
+
+  if (families.graphics == UINT32_MAX)
+    exitOnError("No queue family supports graphics");
+
+  if (families.compute == UINT32_MAX) families.compute = families.graphics;
+
+  // Graphics and compute families support transfers implicitly, and async
+  // compute still runs beside graphics, so it is the next best choice.
+  if (families.transfer == UINT32_MAX) families.transfer = families.compute;
+
+  return families;
+}
+
+// Tessellation and geometry stages may only appear in a barrier when their
+// device features are enabled, and initDevices() enables none.
+#define SHADER_STAGES                                                   \
+  (VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |                                \
+   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+#define FRAGMENT_TEST_STAGES                  \
+  (VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | \
+   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT)
+
+// Which stages may touch an image while it is in a given layout, and which
+// of those accesses read or write it. srcStages is used when leaving the
+// layout and dstStages when entering it; they only differ for layouts that
+// are never entered (UNDEFINED, PREINITIALIZED) or that hand the image to
+// the presentation engine.
+struct LayoutUsage {
+  VkImageLayout layout;
+  VkPipelineStageFlags srcStages;
+  VkPipelineStageFlags dstStages;
+  VkAccessFlags reads;
+  VkAccessFlags writes;
+};
+
+static const LayoutUsage layoutUsages[] = {
+    // Contents are discarded, so nothing earlier has to be waited on.
+    {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0},
+    {VK_IMAGE_LAYOUT_PREINITIALIZED, VK_PIPELINE_STAGE_HOST_BIT,
+     VK_PIPELINE_STAGE_HOST_BIT, 0, VK_ACCESS_HOST_WRITE_BIT},
+    {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT,
+     VK_ACCESS_MEMORY_WRITE_BIT},
+    {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+     VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+     VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, FRAGMENT_TEST_STAGES,
+     FRAGMENT_TEST_STAGES, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+     FRAGMENT_TEST_STAGES | SHADER_STAGES,
+     FRAGMENT_TEST_STAGES | SHADER_STAGES,
+     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+         VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+     0},
+    {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, SHADER_STAGES,
+     SHADER_STAGES,
+     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, 0},
+    {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0},
+    {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT},
+    // Leaving PRESENT_SRC happens right after an acquire, so the source
+    // stage has to match the stage the acquire semaphore was waited on for
+    // the barrier to chain with it. Entering it only needs to happen before
+    // the semaphore signal that present waits on.
+    {VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, ACQUIRE_WAIT_STAGE,
+     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0}};
+
+static const LayoutUsage &findLayoutUsage(VkImageLayout layout) {
+  // Layouts this table does not know about get full serialization.
+  static const LayoutUsage unknown = {
+      layout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT,
+      VK_ACCESS_MEMORY_WRITE_BIT};
+
+  for (uint32_t i = 0; i < sizeof(layoutUsages) / sizeof(layoutUsages[0]); i++)
+    if (layoutUsages[i].layout == layout) return layoutUsages[i];
+
+  return unknown;
+}
+
+// Only writes need to be made available. Reads done in the old layout are
+// covered by the execution dependency alone (write-after-read).
+VulkanTools::LayoutSync VulkanTools::layoutSrcSync(VkImageLayout layout) {
+  const LayoutUsage &usage = findLayoutUsage(layout);
+  LayoutSync sync = {usage.srcStages, usage.writes};
+  return sync;
+}
+
+VulkanTools::LayoutSync VulkanTools::layoutDstSync(VkImageLayout layout) {
+  const LayoutUsage &usage = findLayoutUsage(layout);
+  LayoutSync sync = {usage.dstStages, usage.reads | usage.writes};
+  return sync;
+}
+
+VkImageMemoryBarrier VulkanTools::imageLayoutBarrier(VkImage image,
+                                                     VkImageAspectFlags aspects,
+                                                     VkImageLayout oldLayout,
+                                                     VkImageLayout newLayout) {
   VkImageMemoryBarrier imageBarrier = {};
   imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   imageBarrier.pNext = NULL;
+  imageBarrier.srcAccessMask = layoutSrcSync(oldLayout).access;
+  imageBarrier.dstAccessMask = layoutDstSync(newLayout).access;
   imageBarrier.oldLayout = oldLayout;
   imageBarrier.newLayout = newLayout;
   imageBarrier.image = image;
@@ -24,51 +221,30 @@ void VulkanTools::setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
   imageBarrier.subresourceRange.baseMipLevel = 0;
   imageBarrier.subresourceRange.levelCount = 1;
   imageBarrier.subresourceRange.layerCount = 1;
+  imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
-  switch (oldLayout) {
-    case VK_IMAGE_LAYOUT_PREINITIALIZED:
-      imageBarrier.srcAccessMask =
-          VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-      imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-      imageBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-      imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-      imageBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-      break;
-  }
+  return imageBarrier;
+}
 
-  switch (newLayout) {
-    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-      imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-      imageBarrier.srcAccessMask |= VK_ACCESS_TRANSFER_READ_BIT;
-      imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-      imageBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-      imageBarrier.dstAccessMask |=
-          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-      break;
-    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-      imageBarrier.srcAccessMask =
-          VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
-      imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-      break;
-  }
+void VulkanTools::setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
+                                 VkImageAspectFlags aspects,
+                                 VkImageLayout oldLayout,
+                                 VkImageLayout newLayout) {
+  setImageLayout(cmdBuffer, image, aspects, oldLayout, newLayout,
+                 layoutSrcSync(oldLayout).stages,
+                 layoutDstSync(newLayout).stages);
+}
+
+void VulkanTools::setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
+                                 VkImageAspectFlags aspects,
+                                 VkImageLayout oldLayout,
+                                 VkImageLayout newLayout,
+                                 VkPipelineStageFlags srcStages,
+                                 VkPipelineStageFlags dstStages) {
+  VkImageMemoryBarrier imageBarrier =
+      imageLayoutBarrier(image, aspects, oldLayout, newLayout);
 
-  VkPipelineStageFlagBits srcFlags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-  VkPipelineStageFlagBits dstFlags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-  vkCmdPipelineBarrier(cmdBuffer, srcFlags, dstFlags, 0, 0, NULL, 0, NULL, 1,
-                       &imageBarrier);
+  vkd.CmdPipelineBarrier(cmdBuffer, srcStages, dstStages, 0, 0, NULL, 0, NULL,
+                         1, &imageBarrier);
 }
@@ -1,6 +1,7 @@
 #ifndef VULKAN_TOOLS_HPP
 #define VULKAN_TOOLS_HPP
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #if defined(_WIN32)
@@ -8,16 +9,60 @@
 #endif
 #include <vulkan/vulkan.h>
 
+#include "VulkanLoader.hpp"
+
 #define APPLICATION_NAME "Vulkan Example"
 #define ENGINE_NAME "Vulkan Engine"
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
+#define FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT 8
+#define RESIZE_DEBOUNCE_MS 50
+#define ACQUIRE_TIMEOUT_MS 100
+// Stage at which a frame waits for its acquired swapchain image. Everything
+// the frame does to that image happens in transfer commands.
+#define ACQUIRE_WAIT_STAGE VK_PIPELINE_STAGE_TRANSFER_BIT
+// Frames the allocation check gives the loop to fill its caches.
+#define ALLOCATION_WARMUP_FRAMES 100
+// Side of the square the compute queue clears and each frame copies on top.
+#define COMPUTE_OVERLAY_SIZE 128
+// The overlay is stamped over the frame in a checkerboard of tiles this
+// size, recorded as one job per row of tiles.
+#define RECORD_TILE_SIZE 64
+#define MAX_RECORD_THREADS 16
 
 namespace VulkanTools {
+struct LayoutSync {
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+};
+
+// Queue families to create queues from. Roles without a family of their own
+// share the graphics family.
+struct QueueFamilies {
+  uint32_t graphics;
+  uint32_t compute;
+  uint32_t transfer;
+};
+
 void exitOnError(const char *msg);
+uint32_t getEnvUint(const char *name, uint32_t defaultValue);
+bool hasInstanceExtension(const char *name);
+bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char *name);
+QueueFamilies findQueueFamilies(VkPhysicalDevice physicalDevice);
+LayoutSync layoutSrcSync(VkImageLayout layout);
+LayoutSync layoutDstSync(VkImageLayout layout);
+VkImageMemoryBarrier imageLayoutBarrier(VkImage image,
+                                        VkImageAspectFlags aspects,
+                                        VkImageLayout oldLayout,
+                                        VkImageLayout newLayout);
 void setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
                     VkImageAspectFlags aspects, VkImageLayout oldLayout,
                     VkImageLayout newLayout);
+void setImageLayout(VkCommandBuffer cmdBuffer, VkImage image,
+                    VkImageAspectFlags aspects, VkImageLayout oldLayout,
+                    VkImageLayout newLayout, VkPipelineStageFlags srcStages,
+                    VkPipelineStageFlags dstStages);
 }
 
 #endif  // VULKAN_TOOLS_HPP
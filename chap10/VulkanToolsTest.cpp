@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.hpp"
+
+// Checks the layout table behind VulkanTools::layoutSrcSync() and
+// layoutDstSync() against the synchronization rules of the Vulkan spec, and
+// the parsing of VulkanTools::getEnvUint(). Nothing here needs a device; run
+// it with `make check`.
+
+static uint32_t failures = 0;
+
+#define CHECK(condition, layout)                                    \
+  do {                                                              \
+    if (!(condition)) {                                             \
+      fprintf(stderr, "%s:%d: %s failed for %s\n", __FILE__, __LINE__, \
+              #condition, layout);                                  \
+      failures++;                                                   \
+    }                                                               \
+  } while (0)
+
+#define SHADER_STAGE_MASK                                             \
+  (VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |                              \
+   VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |                \
+   VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |             \
+   VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |                            \
+   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+#define WRITE_ACCESS                                                   \
+  (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | \
+   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |                      \
+   VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |           \
+   VK_ACCESS_MEMORY_WRITE_BIT)
+
+// The "supported access types" table of the spec, for the Vulkan 1.0
+// stages: every access an access mask may contain given its stage mask.
+static VkAccessFlags supportedAccess(VkPipelineStageFlags stages) {
+  VkAccessFlags access = 0;
+
+  if (stages & VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) return ~0u;
+
+  if (stages & VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT)
+    stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+              VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | SHADER_STAGE_MASK |
+              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT)
+    access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+    access |= VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+  if (stages & SHADER_STAGE_MASK)
+    access |= VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+              VK_ACCESS_SHADER_WRITE_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+    access |= VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+    access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  if (stages & (VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT))
+    access |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_TRANSFER_BIT)
+    access |= VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  if (stages & VK_PIPELINE_STAGE_HOST_BIT)
+    access |= VK_ACCESS_HOST_READ_BIT | VK_ACCESS_HOST_WRITE_BIT;
+
+  // Any stage that accesses memory at all may use the generic bits.
+  if (stages & ~(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT |
+                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT))
+    access |= VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+  return access;
+}
+
+struct LayoutCase {
+  VkImageLayout layout;
+  const char *name;
+  bool readOnly;
+};
+
+static const LayoutCase layouts[] = {
+    {VK_IMAGE_LAYOUT_UNDEFINED, "UNDEFINED", true},
+    {VK_IMAGE_LAYOUT_PREINITIALIZED, "PREINITIALIZED", false},
+    {VK_IMAGE_LAYOUT_GENERAL, "GENERAL", false},
+    {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, "COLOR_ATTACHMENT_OPTIMAL",
+     false},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+     "DEPTH_STENCIL_ATTACHMENT_OPTIMAL", false},
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+     "DEPTH_STENCIL_READ_ONLY_OPTIMAL", true},
+    {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, "SHADER_READ_ONLY_OPTIMAL",
+     true},
+    {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, "TRANSFER_SRC_OPTIMAL", true},
+    {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, "TRANSFER_DST_OPTIMAL", false},
+    {VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, "PRESENT_SRC_KHR", true},
+    // Not in the table, so it takes the fallback.
+    {(VkImageLayout)0x7ffffff0, "unknown layout", false}};
+
+// Rules every entry has to follow, whatever its stages.
+static void checkRules(const LayoutCase &c) {
+  VulkanTools::LayoutSync src = VulkanTools::layoutSrcSync(c.layout);
+  VulkanTools::LayoutSync dst = VulkanTools::layoutDstSync(c.layout);
+
+  // A stage mask of zero is invalid without synchronization2.
+  CHECK(src.stages != 0, c.name);
+  CHECK(dst.stages != 0, c.name);
+
+  // VUID-vkCmdPipelineBarrier-srcAccessMask-02815 and dstAccessMask-02816.
+  CHECK((src.access & ~supportedAccess(src.stages)) == 0, c.name);
+  CHECK((dst.access & ~supportedAccess(dst.stages)) == 0, c.name);
+
+  // VUID-vkCmdPipelineBarrier-srcStageMask-04090 and 04091: the device is
+  // created without the geometry and tessellation features.
+  VkPipelineStageFlags optional =
+      VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
+      VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+      VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT;
+  CHECK((src.stages & optional) == 0, c.name);
+  CHECK((dst.stages & optional) == 0, c.name);
+
+  // Only writes need an availability operation.
+  CHECK((src.access & ~WRITE_ACCESS) == 0, c.name);
+
+  if (c.readOnly) CHECK(src.access == 0, c.name);
+
+  VkImageMemoryBarrier barrier = VulkanTools::imageLayoutBarrier(
+      VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, c.layout,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  CHECK(barrier.srcAccessMask == src.access, c.name);
+  CHECK(barrier.oldLayout == c.layout, c.name);
+  CHECK(barrier.srcQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED, c.name);
+  CHECK(barrier.dstQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED, c.name);
+}
+
+static void checkSync(VulkanTools::LayoutSync sync,
+                      VkPipelineStageFlags stages, VkAccessFlags access,
+                      const char *name) {
+  CHECK(sync.stages == stages, name);
+  CHECK(sync.access == access, name);
+}
+
+// The entries the example relies on, spelled out.
+static void checkExpected() {
+  using VulkanTools::layoutDstSync;
+  using VulkanTools::layoutSrcSync;
+
+  checkSync(layoutSrcSync(VK_IMAGE_LAYOUT_UNDEFINED),
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, "UNDEFINED");
+  checkSync(layoutSrcSync(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            "TRANSFER_DST_OPTIMAL");
+  checkSync(layoutDstSync(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            "TRANSFER_DST_OPTIMAL");
+  checkSync(layoutDstSync(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            "TRANSFER_SRC_OPTIMAL");
+  checkSync(layoutSrcSync(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, "COLOR_ATTACHMENT_OPTIMAL");
+  checkSync(layoutDstSync(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+            "SHADER_READ_ONLY_OPTIMAL");
+
+  // Leaving PRESENT_SRC must chain with the acquire semaphore wait, and
+  // entering it only has to finish before the signal present waits on.
+  checkSync(layoutSrcSync(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR),
+            ACQUIRE_WAIT_STAGE, 0, "PRESENT_SRC_KHR");
+  checkSync(layoutDstSync(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR),
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, "PRESENT_SRC_KHR");
+
+  checkSync(layoutSrcSync((VkImageLayout)0x7ffffff0),
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+            "unknown layout");
+  checkSync(layoutDstSync((VkImageLayout)0x7ffffff0),
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+            "unknown layout");
+}
+
+static void checkEnv(const char *value, uint32_t expected) {
+  setenv("VULKAN_TOOLS_TEST", value, 1);
+  CHECK(VulkanTools::getEnvUint("VULKAN_TOOLS_TEST", 7) == expected, value);
+}
+
+// Anything that is not a plain decimal uint32_t gives the default back.
+static void checkEnvParsing() {
+  checkEnv("", 7);
+  checkEnv("0", 0);
+  checkEnv("42", 42);
+  checkEnv("4294967295", 4294967295u);
+  checkEnv("4294967296", 7);
+  checkEnv("99999999999999999999999", 7);
+  checkEnv("-1", 7);
+  checkEnv(" 3", 7);
+  checkEnv("+3", 7);
+  checkEnv("3x", 7);
+  unsetenv("VULKAN_TOOLS_TEST");
+  CHECK(VulkanTools::getEnvUint("VULKAN_TOOLS_TEST", 7) == 7, "unset");
+}
+
+int main() {
+  for (uint32_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+    checkRules(layouts[i]);
+
+  checkExpected();
+  checkEnvParsing();
+
+  if (failures > 0) {
+    fprintf(stderr, "%u checks failed\n", failures);
+    return 1;
+  }
+
+  fprintf(stdout, "All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include "VulkanUploadRing.hpp"
+
+#include <cassert>
+
+#include "VulkanDeviceTable.hpp"
+#include "VulkanHostAllocator.hpp"
+#include "VulkanTools.hpp"
+
+VulkanUploadRing::VulkanUploadRing()
+    : device(VK_NULL_HANDLE),
+      allocator(NULL),
+      buffer(VK_NULL_HANDLE),
+      mapped(NULL),
+      capacity(0),
+      atomSize(1),
+      coherent(true),
+      head(0),
+      tail(0),
+      frameStart(0),
+      uploadedBytes(0),
+      overflows(0) {
+  memory.memory = VK_NULL_HANDLE;
+}
+
+void VulkanUploadRing::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                            VulkanMemoryAllocator &allocator,
+                            VkDeviceSize size, uint32_t slotCount,
+                            VkBufferUsageFlags usage) {
+  this->device = device;
+  this->allocator = &allocator;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  atomSize = properties.limits.nonCoherentAtomSize;
+
+  if (atomSize == 0) atomSize = 1;
+
+  // Flushes are rounded out to whole atoms, which must stay inside the
+  // buffer.
+  capacity = (size + atomSize - 1) / atomSize * atomSize;
+
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.pNext = NULL;
+  bufferInfo.flags = 0;
+  bufferInfo.size = capacity;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  bufferInfo.queueFamilyIndexCount = 0;
+  bufferInfo.pQueueFamilyIndices = NULL;
+
+  VkResult result =
+      vkd.CreateBuffer(device, &bufferInfo,
+                       hostAllocator.callbacks(HOST_OBJECT_BUFFER), &buffer);
+  assert(result == VK_SUCCESS);
+
+  memory = allocator.allocateBuffer(buffer,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  mapped = (uint8_t *)memory.mapped;
+  coherent = (allocator.properties().memoryTypes[memory.memoryType]
+                  .propertyFlags &
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+  head = 0;
+  tail = 0;
+  frameStart = 0;
+  slotEnds.assign(slotCount, 0);
+}
+
+void VulkanUploadRing::destroy() {
+  if (buffer == VK_NULL_HANDLE) return;
+
+  vkd.DestroyBuffer(device, buffer,
+                    hostAllocator.callbacks(HOST_OBJECT_BUFFER));
+  allocator->free(memory);
+  buffer = VK_NULL_HANDLE;
+  mapped = NULL;
+}
+
+void VulkanUploadRing::beginFrame(uint32_t slot) {
+  // Frames complete in submission order, so the slot's fence covers every
+  // older frame as well.
+  if (slotEnds[slot] > tail) tail = slotEnds[slot];
+
+  frameStart = head;
+}
+
+void *VulkanUploadRing::allocate(VkDeviceSize size, VkDeviceSize alignment,
+                                 VkDeviceSize &offset) {
+  if (alignment == 0) alignment = 1;
+
+  assert((alignment & (alignment - 1)) == 0);
+
+  VkDeviceSize current = head % capacity;
+  VkDeviceSize aligned = (current + alignment - 1) & ~(alignment - 1);
+  uint64_t position = head + (aligned - current);
+
+  // Allocations never wrap; the rest of the buffer is skipped instead.
+  if (aligned + size > capacity) {
+    position = head + (capacity - current);
+    aligned = 0;
+  }
+
+  if (size > capacity || position + size - tail > capacity) {
+    overflows++;
+    return NULL;
+  }
+
+  head = position + size;
+  uploadedBytes += size;
+  offset = aligned;
+  return mapped + aligned;
+}
+
+void VulkanUploadRing::flush(VkDeviceSize begin, VkDeviceSize end,
+                             VkMappedMemoryRange *range) {
+  begin = begin / atomSize * atomSize;
+  end = (end + atomSize - 1) / atomSize * atomSize;
+
+  range->sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range->pNext = NULL;
+  range->memory = memory.memory;
+  range->offset = memory.offset + begin;
+  range->size = end - begin;
+}
+
+void VulkanUploadRing::endFrame(uint32_t slot) {
+  slotEnds[slot] = head;
+
+  if (coherent || head == frameStart) return;
+
+  VkMappedMemoryRange ranges[2];
+  uint32_t rangeCount = 0;
+  VkDeviceSize length = head - frameStart;
+  VkDeviceSize begin = frameStart % capacity;
+
+  if (begin + length <= capacity) {
+    flush(begin, begin + length, &ranges[rangeCount++]);
+  } else {
+    flush(begin, capacity, &ranges[rangeCount++]);
+    flush(0, begin + length - capacity, &ranges[rangeCount++]);
+  }
+
+  VkResult result = vkd.FlushMappedMemoryRanges(device, rangeCount, ranges);
+  assert(result == VK_SUCCESS);
+}
@@ -0,0 +1,77 @@
+#ifndef VULKAN_UPLOAD_RING_HPP
+#define VULKAN_UPLOAD_RING_HPP
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "VulkanMemoryAllocator.hpp"
+
+#define UPLOAD_RING_SIZE (16ULL << 20)
+
+// Per-frame uniform and vertex data and texture staging come from one
+// persistently mapped, host-visible buffer. Allocations are bump-allocated
+// at the head of a ring; each frame slot remembers where the head was when
+// its frame was submitted, and once the slot's fence has signalled
+// everything before that point is free again. Uploads therefore never map,
+// unmap or allocate, and non-coherent memory gets one flush per frame.
+//
+// Usage per frame: beginFrame() after the slot's fence wait, allocate()
+// while recording, endFrame() before submitting.
+class VulkanUploadRing {
+ private:
+  VkDevice device;
+  VulkanMemoryAllocator *allocator;
+  VkBuffer buffer;
+  MemoryAllocation memory;
+  uint8_t *mapped;
+  VkDeviceSize capacity;
+  VkDeviceSize atomSize;
+  bool coherent;
+
+  // Positions only ever grow; the offset into the buffer is
+  // position % capacity.
+  uint64_t head;
+  uint64_t tail;
+  uint64_t frameStart;
+  std::vector<uint64_t> slotEnds;
+
+  uint64_t uploadedBytes;
+  uint32_t overflows;
+
+  void flush(VkDeviceSize begin, VkDeviceSize end, VkMappedMemoryRange *range);
+
+ public:
+  VulkanUploadRing();
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            VulkanMemoryAllocator &allocator, VkDeviceSize size,
+            uint32_t slotCount, VkBufferUsageFlags usage);
+  void destroy();
+
+  void beginFrame(uint32_t slot);
+
+  // Returns where to write `size` bytes, and their offset in handle(), or
+  // NULL if the frames in flight still hold too much of the ring.
+  // `alignment` must be a power of two; 0 means no alignment.
+  void *allocate(VkDeviceSize size, VkDeviceSize alignment,
+                 VkDeviceSize &offset);
+
+  void endFrame(uint32_t slot);
+
+  VkBuffer handle() const { return buffer; }
+  VkDeviceSize size() const { return capacity; }
+
+  uint64_t takeUploadedBytes() {
+    uint64_t bytes = uploadedBytes;
+    uploadedBytes = 0;
+    return bytes;
+  }
+
+  uint32_t takeOverflows() {
+    uint32_t count = overflows;
+    overflows = 0;
+    return count;
+  }
+};
+
+#endif  // VULKAN_UPLOAD_RING_HPP
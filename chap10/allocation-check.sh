@@ -0,0 +1,24 @@
+#!/bin/sh
+# Runs chap10 with VK_ALLOCATION_CHECK set and fails if any frame after the
+# warm-up calls operator new, or makes the host allocator fall back to the
+# heap for the driver. Plain malloc() inside the driver, the loader or libxcb
+# is not seen, so this does not prove a frame allocation-free, only that the
+# example and what it hands the driver are. The host allocator is forced on
+# so driver allocations reach it. `make check` runs it with CHAP10 set to the
+# built example; it is skipped unless VK_ICD_JSON names a driver manifest,
+# such as lavapipe's, and DISPLAY names an X server to draw on.
+# CHECK_FRAMES sets the frames run (default 10000).
+
+binary=${CHAP10:-$1}
+if [ -z "$VK_ICD_JSON" ] || [ -z "$DISPLAY" ]; then
+  echo "VK_ICD_JSON and DISPLAY are needed; skipping the allocation check"
+  exit 77
+fi
+
+if [ -z "$binary" ] || [ ! -x "$binary" ]; then
+  echo "usage: $0 <path to chap10>" >&2
+  exit 2
+fi
+
+VK_ALLOCATION_CHECK=1 VK_HOST_ALLOCATOR=1 VK_FRAME_LIMIT=${CHECK_FRAMES:-10000} \
+  "$binary"
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Runs each benchmark suite and prints one line per case. Frame-rate suites
+# run chap10 under each setting and report its average frame rate; the others
+# run VulkanMicroBench, which times single calls in a tight loop. Run it
+# through `make bench`, or directly:
+#
+#   bench.sh <path to chap10> [suite...]
+#
+# Suites:
+#   pool      time per whole-pool reset against per-buffer reset (micro)
+#   dispatch  time per call through the device dispatch table against the
+#             loader trampolines (micro)
+#   upload    upload ring throughput at several sizes per frame
+#
+# MICROBENCH is the path to VulkanMicroBench (default ./VulkanMicroBench).
+# The example needs an X display. Select the driver with VK_ICD_JSON, for
+# example the lavapipe or mock ICD manifest. BENCH_FRAMES sets the frames
+# per case (default 3000); the first second of each run is not counted.
+
+binary=$1
+shift
+if [ -z "$binary" ] || [ ! -x "$binary" ]; then
+  echo "usage: $0 <path to chap10> [suite...]" >&2
+  exit 2
+fi
+
+if [ $# -eq 0 ]; then
+  set -- pool dispatch upload
+fi
+
+frames=${BENCH_FRAMES:-3000}
+microbench=${MICROBENCH:-./VulkanMicroBench}
+
+# run_micro <suite>
+run_micro() {
+  if [ ! -x "$microbench" ]; then
+    echo "$microbench not found; build it with make VulkanMicroBench" >&2
+    exit 2
+  fi
+  "$microbench" "$1" || exit $?
+}
+
+# run_case <label> [VAR=value...]
+run_case() {
+  label=$1
+  shift
+  env "$@" VK_FRAME_LIMIT="$frames" VK_PRESENT_PROFILE=low-latency \
+    "$binary" 2>&1 | awk -v label="$label" '
+    / fps, / {
+      if (fpsLines++ > 0) { fps += $1; fpsCount++ }
+    }
+    /^Uploads: / {
+      if (uploadLines++ > 0) { upload += $2; uploadCount++ }
+    }
+    END {
+      if (fpsCount == 0) {
+        printf "%-28s no frame statistics\n", label
+        exit
+      }
+      printf "%-28s %10.1f fps", label, fps / fpsCount
+      if (uploadCount > 0) printf " %10.1f MB/s", upload / uploadCount
+      printf "\n"
+    }'
+}
+
+for suite in "$@"; do
+  case $suite in
+    pool)
+      run_micro pool
+      ;;
+    dispatch)
+      run_micro dispatch
+      ;;
+    upload)
+      for mb in 1 4 16; do
+        run_case "uploads, $mb MiB per frame" VK_UPLOAD_STRESS_MB=$mb \
+          VK_UPLOAD_RING_MB=$((mb * 8))
+      done
+      ;;
+    *)
+      echo "unknown suite: $suite" >&2
+      exit 2
+      ;;
+  esac
+done